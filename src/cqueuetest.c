@@ -0,0 +1,232 @@
+/** @file cqueuetest.c
+ *
+ *  Tests for the concurrent priority queue.
+ *
+ *  ./cqueuetest                     stress test, several producers and consumers
+ *  ./cqueuetest bench [threads] [n] throughput for 1..threads threads against
+ *                                   one priqueue_t behind a single mutex
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "libpriqueue/libpriqueue.h"
+#include "libpriqueue/libcpriqueue.h"
+
+#define PRODUCERS 4
+#define CONSUMERS 4
+#define PER_PRODUCER 100000
+
+int compare1(const void * a, const void * b)
+{
+	return ( *(int*)a - *(int*)b );
+}
+
+double now_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+
+/*
+ * Stress test.  Elements are allocated by the producers and freed by the
+ * consumer that polls them, so comparing an element another thread has
+ * already taken shows up as a use after free under -fsanitize=address.
+ * The key comes first, so compare1 orders them.
+ */
+
+typedef struct _element_t
+{
+	int key;
+	int id;
+} element_t;
+
+cpriqueue_t cq;
+int *values;
+atomic_char *seen;
+atomic_int consumed;
+atomic_int duplicates;
+
+void *producer(void *arg)
+{
+	int first = *(int *)arg;
+	for (int i = first; i < first + PER_PRODUCER; i++)
+	{
+		element_t *e = malloc(sizeof(element_t));
+		e->key = values[i];
+		e->id = i;
+		cpriqueue_offer(&cq, e);
+	}
+	return NULL;
+}
+
+void *consumer(void *arg)
+{
+	while (atomic_load(&consumed) < PRODUCERS * PER_PRODUCER)
+	{
+		element_t *e = cpriqueue_poll(&cq);
+		if (NULL == e)
+			continue;
+		if (0 != atomic_exchange(&seen[e->id], 1))
+			atomic_fetch_add(&duplicates, 1);
+		free(e);
+		atomic_fetch_add(&consumed, 1);
+	}
+	return NULL;
+}
+
+int stress()
+{
+	int total = PRODUCERS * PER_PRODUCER;
+	pthread_t threads[PRODUCERS + CONSUMERS];
+	int firsts[PRODUCERS];
+	int i;
+
+	values = malloc(total * sizeof(int));
+	seen = calloc(total, sizeof(atomic_char));
+	for (i = 0; i < total; i++)
+		values[i] = rand() % 1000;
+	atomic_init(&consumed, 0);
+	atomic_init(&duplicates, 0);
+
+	cpriqueue_init(&cq, compare1, 2 * (PRODUCERS + CONSUMERS));
+
+	for (i = 0; i < CONSUMERS; i++)
+		pthread_create(&threads[PRODUCERS + i], NULL, consumer, NULL);
+	for (i = 0; i < PRODUCERS; i++)
+	{
+		firsts[i] = i * PER_PRODUCER;
+		pthread_create(&threads[i], NULL, producer, &firsts[i]);
+	}
+	for (i = 0; i < PRODUCERS + CONSUMERS; i++)
+		pthread_join(threads[i], NULL);
+
+	int missing = 0;
+	for (i = 0; i < total; i++)
+		if (0 == seen[i])
+			missing++;
+
+	printf("%d producers, %d consumers, %d elements:\n", PRODUCERS, CONSUMERS, total);
+	printf("  consumed %d (expected %d)\n", atomic_load(&consumed), total);
+	printf("  missing %d, duplicates %d (expected 0 0)\n", missing, atomic_load(&duplicates));
+	printf("  size after drain %d, poll %s (expected 0, NULL)\n",
+		cpriqueue_size(&cq), (NULL == cpriqueue_poll(&cq)) ? "NULL" : "non-NULL");
+
+	int failed = (missing != 0 || atomic_load(&duplicates) != 0 || cpriqueue_size(&cq) != 0);
+	printf("%s\n", failed ? "FAILED" : "OK");
+
+	cpriqueue_destroy(&cq);
+	free(seen);
+	free(values);
+	return failed;
+}
+
+
+/*
+ * Scaling benchmark, hold model: every thread polls an element, pushes its
+ * key back by a random amount and offers it again, so the queue keeps its
+ * size and inserts land all over it.
+ */
+
+typedef struct _bench_arg_t
+{
+	int ops;
+	unsigned int seed;
+} bench_arg_t;
+
+priqueue_t locked_q;
+pthread_mutex_t locked_q_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void *bench_cpriqueue(void *arg)
+{
+	bench_arg_t *a = arg;
+	for (int i = 0; i < a->ops; i++)
+	{
+		int *v = cpriqueue_poll(&cq);
+		if (NULL == v)
+			continue;
+		*v += rand_r(&a->seed) % 1000;
+		cpriqueue_offer(&cq, v);
+	}
+	return NULL;
+}
+
+void *bench_locked(void *arg)
+{
+	bench_arg_t *a = arg;
+	for (int i = 0; i < a->ops; i++)
+	{
+		pthread_mutex_lock(&locked_q_lock);
+		int *v = priqueue_poll(&locked_q);
+		pthread_mutex_unlock(&locked_q_lock);
+		if (NULL == v)
+			continue;
+		*v += rand_r(&a->seed) % 1000;
+		pthread_mutex_lock(&locked_q_lock);
+		priqueue_offer(&locked_q, v);
+		pthread_mutex_unlock(&locked_q_lock);
+	}
+	return NULL;
+}
+
+double run_bench(void *(*fn)(void *), int threads, int n)
+{
+	pthread_t tids[threads];
+	bench_arg_t args[threads];
+	double start = now_ms();
+	for (int i = 0; i < threads; i++)
+	{
+		args[i].ops = n / threads;
+		args[i].seed = i * 7919 + 1;
+		pthread_create(&tids[i], NULL, fn, &args[i]);
+	}
+	for (int i = 0; i < threads; i++)
+		pthread_join(tids[i], NULL);
+	double ms = now_ms() - start;
+	return (ms > 0) ? 2.0 * n / ms / 1000.0 : 0;
+}
+
+int bench(int max_threads, int n)
+{
+	int *keys = malloc(2 * 1024 * sizeof(int));
+
+	printf("%d offer+poll pairs, Mops/s:\n", n);
+	printf("  threads    cpriqueue   priqueue+mutex\n");
+	for (int t = 1; t <= max_threads; t++)
+	{
+		cpriqueue_init(&cq, compare1, 2 * t);
+		priqueue_init(&locked_q, compare1);
+		for (int i = 0; i < 1024; i++)
+		{
+			keys[i] = keys[1024 + i] = rand() % 1000;
+			cpriqueue_offer(&cq, &keys[i]);
+			priqueue_offer(&locked_q, &keys[1024 + i]);
+		}
+
+		double c = run_bench(bench_cpriqueue, t, n);
+		double l = run_bench(bench_locked, t, n);
+		printf("  %7d %12.2f %16.2f\n", t, c, l);
+
+		cpriqueue_destroy(&cq);
+		priqueue_destroy(&locked_q);
+	}
+
+	free(keys);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	srand(678);
+
+	if (argc > 1 && strcmp(argv[1], "bench") == 0)
+		return bench((argc > 2) ? atoi(argv[2]) : 8, (argc > 3) ? atoi(argv[3]) : 1000000);
+
+	return stress();
+}
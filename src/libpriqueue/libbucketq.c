@@ -0,0 +1,232 @@
+/** @file libbucketq.c
+ *
+ *  Bucket queue for small integer keys such as job priorities.  Offer, peek,
+ *  poll and remove are O(1) for a fixed number of buckets: the lowest
+ *  non-empty bucket comes from a bitmap, and each bucket is a linked list.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "libbucketq.h"
+
+#define DEBUG 0
+
+#define WORD_BITS	64
+
+
+/**
+ * @brief Returns the index of the lowest non-empty bucket, or -1
+ */
+static int lowest_bucket(bucketq_t *bq){
+	int words = (bq->buckets + WORD_BITS - 1) / WORD_BITS;
+	for(int w = 0; w < words; ++w){
+		if(0 != bq->bitmap[w]){
+			return w * WORD_BITS + __builtin_ctzll(bq->bitmap[w]);
+		}
+	}
+	return -1;
+}
+
+
+/**
+  Initializes the bucketq_t data structure.
+
+  @param bq a pointer to an instance of the bucketq_t data structure
+  @param buckets the number of distinct keys, which are 0 to buckets-1
+ */
+void bucketq_init(bucketq_t *bq, int buckets)
+{
+	int words = (buckets + WORD_BITS - 1) / WORD_BITS;
+	bq->head = calloc(buckets, sizeof(bucket_node_t *));
+	bq->tail = calloc(buckets, sizeof(bucket_node_t *));
+	bq->bitmap = calloc(words, sizeof(unsigned long long));
+	if(NULL == bq->head || NULL == bq->tail || NULL == bq->bitmap){
+		fprintf(stderr, "Out of memory.\n");
+		exit(2);
+	}
+	bq->buckets = buckets;
+	bq->size = 0;
+	bq->free = NULL;
+}
+
+
+/**
+  Inserts the specified element into the bucket for key.
+
+  Inside a bucket elements are kept in ascending order, with ties in FIFO
+  order.  An element whose order is at least that of everything in its
+  bucket, such as a newly arrived job, goes in at the tail, and one whose
+  order is below that of everything in its bucket, such as a preempted job
+  going back, goes in at the head, both in O(1).  Anything else is placed by
+  walking back from the tail.
+
+  @param bq a pointer to an instance of the bucketq_t data structure
+  @param ptr a pointer to the data to be inserted
+  @param key the bucket, between 0 and buckets-1
+  @param order position of the element inside its bucket
+  @return a handle to the new element, valid until it leaves the queue
+ */
+bucket_node_t *bucketq_offer(bucketq_t *bq, void *ptr, int key, unsigned long order)
+{
+	bucket_node_t *node = bq->free;
+	if(NULL != node){
+		bq->free = node->next;
+	}
+	else{
+		node = malloc(sizeof(bucket_node_t));
+		if(NULL == node){
+			fprintf(stderr, "Out of memory.\n");
+			exit(2);
+		}
+	}
+	node->value = ptr;
+	node->order = order;
+	node->bucket = key;
+
+	bucket_node_t *prev = bq->tail[key];
+	if(NULL != prev && prev->order > order){
+		if(bq->head[key]->order > order){
+			prev = NULL;
+		}
+		else{
+			while(prev->order > order){
+				prev = prev->prev;
+			}
+		}
+	}
+	node->prev = prev;
+	node->next = (NULL == prev) ? bq->head[key] : prev->next;
+	if(NULL == prev){
+		bq->head[key] = node;
+	}
+	else{
+		prev->next = node;
+	}
+	if(NULL == node->next){
+		bq->tail[key] = node;
+	}
+	else{
+		node->next->prev = node;
+	}
+
+	bq->bitmap[key / WORD_BITS] |= 1ULL << (key % WORD_BITS);
+	bq->size++;
+
+	if(DEBUG){
+		printf("Added element with order %lu to bucket %d\n", order, key);
+	}
+	return node;
+}
+
+
+/**
+  Retrieves, but does not remove, the head of the lowest non-empty bucket.
+
+  @param bq a pointer to an instance of the bucketq_t data structure
+  @return the frontmost element
+  @return NULL if the queue is empty
+ */
+void *bucketq_peek(bucketq_t *bq)
+{
+	int key = lowest_bucket(bq);
+	if(0 > key){
+		return NULL;
+	}
+	return bq->head[key]->value;
+}
+
+
+/**
+  Retrieves and removes the head of the lowest non-empty bucket.
+
+  @param bq a pointer to an instance of the bucketq_t data structure
+  @return the frontmost element
+  @return NULL if the queue is empty
+ */
+void *bucketq_poll(bucketq_t *bq)
+{
+	int key = lowest_bucket(bq);
+	if(0 > key){
+		return NULL;
+	}
+	return bucketq_remove(bq, bq->head[key]);
+}
+
+
+/**
+  Removes the element behind a handle in O(1).  The handle is invalid
+  afterwards.
+
+  @param bq a pointer to an instance of the bucketq_t data structure
+  @param handle a handle returned by bucketq_offer()
+  @return the element removed from the queue
+ */
+void *bucketq_remove(bucketq_t *bq, bucket_node_t *handle)
+{
+	int key = handle->bucket;
+	void *ret = handle->value;
+
+	if(NULL == handle->prev){
+		bq->head[key] = handle->next;
+	}
+	else{
+		handle->prev->next = handle->next;
+	}
+	if(NULL == handle->next){
+		bq->tail[key] = handle->prev;
+	}
+	else{
+		handle->next->prev = handle->prev;
+	}
+	if(NULL == bq->head[key]){
+		bq->bitmap[key / WORD_BITS] &= ~(1ULL << (key % WORD_BITS));
+	}
+	bq->size--;
+
+	handle->next = bq->free;
+	bq->free = handle;
+	return ret;
+}
+
+
+/**
+  Returns the number of elements in the queue.
+
+  @param bq a pointer to an instance of the bucketq_t data structure
+  @return the number of elements in the queue
+ */
+int bucketq_size(bucketq_t *bq)
+{
+	return bq->size;
+}
+
+
+/**
+  Destroys and frees all the memory associated with bq.
+
+  @param bq a pointer to an instance of the bucketq_t data structure
+ */
+void bucketq_destroy(bucketq_t *bq)
+{
+	bucket_node_t *temp;
+	for(int key = 0; key < bq->buckets; ++key){
+		while(NULL != bq->head[key]){
+			temp = bq->head[key]->next;
+			free(bq->head[key]);
+			bq->head[key] = temp;
+		}
+	}
+	while(NULL != bq->free){
+		temp = bq->free->next;
+		free(bq->free);
+		bq->free = temp;
+	}
+	free(bq->head);
+	free(bq->tail);
+	free(bq->bitmap);
+	bq->head = NULL;
+	bq->tail = NULL;
+	bq->bitmap = NULL;
+	bq->size = 0;
+}
@@ -0,0 +1,78 @@
+/** @file libbucketq.h
+ */
+
+#ifndef LIBBUCKETQ_H_
+#define LIBBUCKETQ_H_
+
+
+/**
+ * Bucket queue node.  Returned by bucketq_offer as a handle to the element.
+ */
+typedef struct bucket_node_t{
+	void *value;
+
+	// Position inside the bucket, ascending from head to tail
+	unsigned long order;
+
+	int bucket;
+	struct bucket_node_t *next;
+	struct bucket_node_t *prev;
+} bucket_node_t;
+
+
+/**
+ * Bucket queue data structure.  Elements carry a small integer key, and each
+ * key has its own bucket.  A bitmap of the non-empty buckets finds the lowest
+ * one with a single find-first-set per 64 keys.
+ */
+typedef struct _bucketq_t
+{
+	bucket_node_t **head;
+	bucket_node_t **tail;
+	unsigned long long *bitmap;
+	int buckets;
+	int size;
+
+	// Recycled nodes, chained through next
+	bucket_node_t *free;
+
+} bucketq_t;
+
+/**
+ * @brief Initializer for a bucket queue accepting keys 0 to buckets-1
+ */
+void   bucketq_init      (bucketq_t *bq, int buckets);
+
+/**
+ * @brief Inserts ptr under key, behind every element of that key with an
+ * order not greater than order.  Returns a handle to the element.
+ */
+bucket_node_t *bucketq_offer(bucketq_t *bq, void *ptr, int key, unsigned long order);
+
+/**
+ * @brief Returns the first element of the lowest non-empty bucket, or NULL
+ */
+void * bucketq_peek      (bucketq_t *bq);
+
+/**
+ * @brief Removes and returns the first element of the lowest non-empty
+ * bucket, or NULL if the queue is empty
+ */
+void * bucketq_poll      (bucketq_t *bq);
+
+/**
+ * @brief Removes and returns the element behind handle
+ */
+void * bucketq_remove    (bucketq_t *bq, bucket_node_t *handle);
+
+/**
+ * @brief Get the number of elements in this queue
+ */
+int    bucketq_size      (bucketq_t *bq);
+
+/**
+ * @brief Destructor for the bucket queue
+ */
+void   bucketq_destroy   (bucketq_t *bq);
+
+#endif /* LIBBUCKETQ_H_ */
@@ -0,0 +1,267 @@
+/** @file libcpriqueue.c
+ *
+ *  Concurrent priority queue for several producers and consumers, built as a
+ *  relaxed multi-queue.
+ *
+ *  The elements live in a number of small binary heaps (shards), each behind
+ *  its own mutex.  offer pushes into a randomly chosen shard.  poll locks
+ *  two random shards and pops the better of their fronts.  Elements are only
+ *  ever compared under the locks of their shards, since a front read without
+ *  one may be popped and freed by another thread at any time.  Threads
+ *  therefore rarely meet on the same lock, and no single lock serializes the
+ *  queue.
+ *
+ *  The price is that poll is relaxed.  It returns an element close to the
+ *  front rather than always the very best one, and FIFO order among equal
+ *  elements only holds within a shard.  Use priqueue_t where exact order
+ *  matters.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "libcpriqueue.h"
+
+#define DEBUG 0
+
+
+/**
+ * @brief Per-thread xorshift generator for picking shards
+ */
+static unsigned int random_shard(cpriqueue_t *q){
+	static __thread unsigned int state = 0;
+	if(0 == state){
+		state = (unsigned int)(size_t)&state | 1;
+	}
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state % q->num_shards;
+}
+
+
+/**
+ * @brief Same ordering as the heap backend of priqueue_t: in insertion order,
+ * an element stays in front unless the comparer ranks it behind
+ */
+static int precedes(cpriqueue_t *q, cpq_entry_t *a, cpq_entry_t *b){
+	if(a->seq < b->seq){
+		return 0 >= q->compare(a->value, b->value);
+	}
+	return 0 < q->compare(b->value, a->value);
+}
+
+
+/**
+ * @brief Pushes ptr onto a shard whose lock the caller holds
+ */
+static void shard_push(cpriqueue_t *q, cpq_shard_t *shard, void *ptr){
+	if(shard->size == shard->capacity){
+		shard->capacity = (0 == shard->capacity) ? 16 : 2 * shard->capacity;
+		shard->heap = realloc(shard->heap, shard->capacity * sizeof(cpq_entry_t));
+		if(NULL == shard->heap){
+			fprintf(stderr, "Out of memory.\n");
+			exit(2);
+		}
+	}
+	cpq_entry_t temp = { ptr, shard->next_seq++ };
+	int i = shard->size++;
+	while(0 < i && precedes(q, &temp, &shard->heap[(i - 1) / 2])){
+		shard->heap[i] = shard->heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	shard->heap[i] = temp;
+	atomic_store_explicit(&shard->count, shard->size, memory_order_relaxed);
+}
+
+
+/**
+ * @brief Pops the front of a non-empty shard whose lock the caller holds
+ */
+static void *shard_pop(cpriqueue_t *q, cpq_shard_t *shard){
+	void *ret = shard->heap[0].value;
+	cpq_entry_t temp = shard->heap[--shard->size];
+	int i = 0;
+	int child;
+	while((child = 2 * i + 1) < shard->size){
+		if(child + 1 < shard->size && precedes(q, &shard->heap[child + 1], &shard->heap[child])){
+			child++;
+		}
+		if(!precedes(q, &shard->heap[child], &temp)){
+			break;
+		}
+		shard->heap[i] = shard->heap[child];
+		i = child;
+	}
+	shard->heap[i] = temp;
+	atomic_store_explicit(&shard->count, shard->size, memory_order_relaxed);
+	return ret;
+}
+
+
+/**
+  Initializes the cpriqueue_t data structure.
+
+  @param q a pointer to an instance of the cpriqueue_t data structure
+  @param comparer a function pointer that compares two elements, as for
+  	 priqueue_init
+  @param shards number of internal heaps
+ */
+void cpriqueue_init(cpriqueue_t *q, int(*comparer)(const void *, const void *), int shards)
+{
+	if(2 > shards){
+		shards = 2;
+	}
+	if(0 != posix_memalign((void **)&q->shards, 64, shards * sizeof(cpq_shard_t))){
+		fprintf(stderr, "Out of memory.\n");
+		exit(2);
+	}
+	for(int i = 0; i < shards; ++i){
+		pthread_mutex_init(&q->shards[i].lock, NULL);
+		q->shards[i].heap = NULL;
+		q->shards[i].size = 0;
+		q->shards[i].capacity = 0;
+		q->shards[i].next_seq = 0;
+		atomic_init(&q->shards[i].count, 0);
+	}
+	q->num_shards = shards;
+	atomic_init(&q->size, 0);
+	q->compare = comparer;
+}
+
+
+/**
+  Inserts the specified element into a random shard.  If that shard is busy
+  another one is tried, so a producer only blocks once every shard it
+  tried was busy.
+
+  @param q a pointer to an instance of the cpriqueue_t data structure
+  @param ptr a pointer to the data to be inserted
+ */
+void cpriqueue_offer(cpriqueue_t *q, void *ptr)
+{
+	cpq_shard_t *shard;
+	int tries = 0;
+	while(1){
+		shard = &q->shards[random_shard(q)];
+		if(0 == pthread_mutex_trylock(&shard->lock)){
+			break;
+		}
+		if(++tries == q->num_shards){
+			pthread_mutex_lock(&shard->lock);
+			break;
+		}
+	}
+
+	// Counted before it can be polled, so that size never misses an
+	// element some shard holds
+	atomic_fetch_add_explicit(&q->size, 1, memory_order_release);
+	shard_push(q, shard, ptr);
+	pthread_mutex_unlock(&shard->lock);
+}
+
+
+/**
+  Removes an element close to the front of the queue.
+
+  Two random shards are locked and the better of their fronts is popped.  A
+  busy or empty shard is passed over.  After a round of misses every shard
+  is swept in turn, so NULL means that each shard was empty when the sweep
+  reached it.  An element offered concurrently may still be missed.
+
+  @param q a pointer to an instance of the cpriqueue_t data structure
+  @return an element from near the head of this queue
+  @return NULL if this queue is empty
+ */
+void *cpriqueue_poll(cpriqueue_t *q)
+{
+	void *ret = NULL;
+	cpq_shard_t *shard;
+
+	for(int tries = 0; tries < q->num_shards; ++tries){
+		if(0 >= atomic_load_explicit(&q->size, memory_order_acquire)){
+			return NULL;
+		}
+
+		cpq_shard_t *a = &q->shards[random_shard(q)];
+		cpq_shard_t *b = &q->shards[random_shard(q)];
+		if(0 == atomic_load_explicit(&a->count, memory_order_relaxed)){
+			a = b;
+		}
+		if(0 == atomic_load_explicit(&b->count, memory_order_relaxed)){
+			b = a;
+		}
+
+		// Only trylock, so a thread holding one shard never waits for
+		// another.  If the second shard is busy, the first one is used.
+		if(0 != pthread_mutex_trylock(&a->lock)){
+			continue;
+		}
+		shard = a;
+		if(b != a && 0 == pthread_mutex_trylock(&b->lock)){
+			if(0 == a->size || (0 < b->size && 0 < q->compare(a->heap[0].value, b->heap[0].value))){
+				shard = b;
+			}
+		}
+		else{
+			b = a;
+		}
+
+		if(0 < shard->size){
+			ret = shard_pop(q, shard);
+		}
+		if(b != a){
+			pthread_mutex_unlock(&b->lock);
+		}
+		pthread_mutex_unlock(&a->lock);
+		if(NULL != ret){
+			atomic_fetch_sub_explicit(&q->size, 1, memory_order_release);
+			return ret;
+		}
+	}
+
+	// Few elements left or heavy contention, look everywhere
+	for(int i = 0; i < q->num_shards && NULL == ret; ++i){
+		shard = &q->shards[i];
+		pthread_mutex_lock(&shard->lock);
+		if(0 < shard->size){
+			ret = shard_pop(q, shard);
+		}
+		pthread_mutex_unlock(&shard->lock);
+	}
+	if(NULL != ret){
+		atomic_fetch_sub_explicit(&q->size, 1, memory_order_release);
+	}
+	return ret;
+}
+
+
+/**
+  Returns the number of elements in the queue.  Only a snapshot while other
+  threads are offering or polling.
+
+  @param q a pointer to an instance of the cpriqueue_t data structure
+  @return the number of elements in the queue
+ */
+int cpriqueue_size(cpriqueue_t *q)
+{
+	return atomic_load_explicit(&q->size, memory_order_acquire);
+}
+
+
+/**
+  Destroys and frees all the memory associated with q.
+
+  @param q a pointer to an instance of the cpriqueue_t data structure
+ */
+void cpriqueue_destroy(cpriqueue_t *q)
+{
+	for(int i = 0; i < q->num_shards; ++i){
+		pthread_mutex_destroy(&q->shards[i].lock);
+		free(q->shards[i].heap);
+	}
+	free(q->shards);
+	q->shards = NULL;
+	q->num_shards = 0;
+	atomic_store(&q->size, 0);
+}
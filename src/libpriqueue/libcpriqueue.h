@@ -0,0 +1,88 @@
+/** @file libcpriqueue.h
+ */
+
+#ifndef LIBCPRIQUEUE_H_
+#define LIBCPRIQUEUE_H_
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+
+/**
+ * Entry in one of the shard heaps
+ */
+typedef struct _cpq_entry_t{
+	void *value;
+
+	// Insertion order within the shard, keeps equal elements FIFO
+	unsigned long seq;
+} cpq_entry_t;
+
+
+/**
+ * One independently locked heap.  Aligned to a cache line so that threads
+ * working on neighbouring shards do not contend on the same line.
+ */
+typedef struct _cpq_shard_t
+{
+	pthread_mutex_t lock;
+	cpq_entry_t *heap;
+	int size;
+	int capacity;
+	unsigned long next_seq;
+
+	// Number of elements in this shard, readable without the lock.  Only a
+	// hint for skipping empty shards; the fronts themselves are only
+	// compared with the lock held.
+	atomic_int count;
+
+} __attribute__((aligned(64))) cpq_shard_t;
+
+
+/**
+ * Concurrent priority queue data structure.  A relaxed multi-queue: elements
+ * are spread over several heaps, offer picks a random heap, and poll takes
+ * the better front of two random heaps.  size counts every element that is
+ * in a heap, and may briefly count one that is being offered or polled.
+ */
+typedef struct _cpriqueue_t
+{
+	cpq_shard_t *shards;
+	int num_shards;
+	atomic_int size;
+	int (*compare)(const void *, const void *);
+
+} cpriqueue_t;
+
+
+/**
+ * @brief Initializer for a concurrent priority queue spread over shards heaps
+ * (at least 2; twice the number of threads is a good choice)
+ */
+void   cpriqueue_init    (cpriqueue_t *q, int(*comparer)(const void *, const void *), int shards);
+
+/**
+ * @brief Inserts the value at the given address.  Safe to call from any
+ * number of threads.
+ */
+void   cpriqueue_offer   (cpriqueue_t *q, void *ptr);
+
+/**
+ * @brief Removes and returns an element close to the front of the queue, or
+ * NULL if every shard was empty when it was looked at.  Safe to call from
+ * any number of threads.
+ */
+void * cpriqueue_poll    (cpriqueue_t *q);
+
+/**
+ * @brief Get the number of elements in this queue
+ */
+int    cpriqueue_size    (cpriqueue_t *q);
+
+/**
+ * @brief Destructor for the concurrent priority queue.  No other thread may
+ * be using it.
+ */
+void   cpriqueue_destroy (cpriqueue_t *q);
+
+#endif /* LIBCPRIQUEUE_H_ */
@@ -5,6 +5,7 @@
 #include <stdio.h>
 
 #include "libpriqueue.h"
+#include "libpriqueue_pool.h"
 
 #define DEBUG 0
 
@@ -31,6 +32,23 @@ void print_q(priqueue_t *q){
   See also @ref comparer-page
  */
 void priqueue_init(priqueue_t *q, int(*comparer)(const void *, const void *))
+{
+	priqueue_init_capacity(q, comparer, 0);
+}
+
+
+/**
+  Initializes the priqueue_t data structure with room for capacity elements.
+
+  Nodes come from a pool owned by the queue.  Polled and removed nodes go back
+  to the pool, so once the queue has reached its working size offer and poll
+  no longer call malloc or free.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param comparer a function pointer that compares two elements.
+  @param capacity number of nodes to preallocate, or 0 to allocate on demand
+ */
+void priqueue_init_capacity(priqueue_t *q, int(*comparer)(const void *, const void *), int capacity)
 {
 	if(DEBUG){
 		printf("Init queue...\n");	
@@ -38,13 +56,106 @@ void priqueue_init(priqueue_t *q, int(*comparer)(const void *, const void *))
 	q->size = 0;
 	q->front = NULL;
 	q->back = NULL;
+	q->next_seq = 0;
 	q->compare = comparer;
+	node_pool_init(&q->pool, capacity);
 	if(DEBUG){
 		printf("Done init queue...\n");	
 	}
 }
 
 
+/**
+ * @brief Returns non-zero if a belongs in front of b
+ *
+ * The comparer decides, and the insertion sequence settles ties.  This is
+ * the order link_node produces.  Only one comparer call is made, so a
+ * comparer that never returns 0 (like "always -1") still gives a consistent
+ * order.
+ */
+static int precedes(priqueue_t *q, node_t *a, node_t *b){
+	if(a->seq < b->seq){
+		return 0 >= q->compare(a->value, b->value);
+	}
+	return 0 < q->compare(b->value, a->value);
+}
+
+
+/**
+ * @brief Links an unattached node into its sorted position
+ *
+ * Stamps the node with the next insertion sequence number, then walks from
+ * the front past every element that does not rank behind it, so equal
+ * elements stay in FIFO order.
+ *
+ * @return the zero-based index the node was linked at
+ */
+static int link_node(priqueue_t *q, node_t *node){
+	int insertion_point = 0;
+	node_t *temp = q->front;
+	node_t *prev = NULL;
+	node->seq = q->next_seq++;
+	if(DEBUG){
+		printf("Searching for correct position for new value %d...\n", *(int*)node->value);
+	}
+
+	// Two compares in use: 
+	// 	c1(a,b) -> a-b (lowest takes priority)
+	// 	c2(a,b) -> b-a (highest takes priority)
+	while(NULL != temp && 0 >= q->compare(temp->value, node->value)){
+		// proceed until we reach something that has lower
+		// priority or the end
+		prev = temp;
+		temp = temp->next;
+		insertion_point++;
+	}
+
+	node->prev = prev;
+	node->next = temp;
+	if(NULL == prev){
+		q->front = node;
+	}
+	else{
+		prev->next = node;
+	}
+	if(NULL == temp){
+		q->back = node;
+	}
+	else{
+		temp->prev = node;
+	}
+	q->size++;
+
+	if(DEBUG){
+		printf("Added %d to position %d\n", *(int*)node->value, insertion_point);
+		print_q(q);
+	}
+	return insertion_point;
+}
+
+
+/**
+ * @brief Detaches a node from the list in O(1) without freeing it
+ */
+static void unlink_node(priqueue_t *q, node_t *node){
+	if(NULL == node->prev){
+		q->front = node->next;
+	}
+	else{
+		node->prev->next = node->next;
+	}
+	if(NULL == node->next){
+		q->back = node->prev;
+	}
+	else{
+		node->next->prev = node->prev;
+	}
+	node->next = NULL;
+	node->prev = NULL;
+	q->size--;
+}
+
+
 /**
   Inserts the specified element into this priority queue.
 
@@ -54,84 +165,168 @@ void priqueue_init(priqueue_t *q, int(*comparer)(const void *, const void *))
  */
 int priqueue_offer(priqueue_t *q, void *ptr)
 {
-	if(DEBUG){
-		printf("Adding a value...\n");	
+	node_t *temp = node_pool_alloc(&q->pool);
+	temp->value = ptr;
+	return link_node(q, temp);
+}
+
+
+/**
+ * @brief Stable merge sort of nodes[0..n) using the queue's comparer
+ *
+ * Runs are merged the way link_node would place them: a node from the
+ * earlier run stays in front unless the comparer ranks it behind.
+ *
+ * @param scratch room for n pointers
+ */
+static void sort_nodes(priqueue_t *q, node_t **nodes, node_t **scratch, int n){
+	if(2 > n){
+		return;
 	}
-	int insertion_point = 0;
-	if(0 == q->size){
-		if(DEBUG){
-			printf("No previous vals, adding to front...\n");	
+	int half = n / 2;
+	sort_nodes(q, nodes, scratch, half);
+	sort_nodes(q, nodes + half, scratch, n - half);
+
+	int i = 0, j = half, k = 0;
+	while(i < half && j < n){
+		if(0 >= q->compare(nodes[i]->value, nodes[j]->value)){
+			scratch[k++] = nodes[i++];
+		}
+		else{
+			scratch[k++] = nodes[j++];
 		}
+	}
+	while(i < half){
+		scratch[k++] = nodes[i++];
+	}
+	while(j < n){
+		scratch[k++] = nodes[j++];
+	}
+	for(k = 0; k < n; ++k){
+		nodes[k] = scratch[k];
+	}
+}
 
-		// Allocate some space on heap
-		node_t *temp = malloc(sizeof(node_t));
-		q->front = temp;
 
-		// Update front/back ptrs
-		q->back = q->front;
+/**
+  Inserts n elements in O(m + n log n) for a queue of m elements, instead of
+  the O(n * m) of n separate priqueue_offer calls.
 
-		// Fill in given data for the node
-		q->front->value = ptr;
-		q->front->next = NULL;
+  The new elements are sorted among themselves and then merged into the list
+  in a single walk, which gives the same order as offering them one by one.
 
-		// Update size
-		q->size++;
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param ptrs the elements to insert, in the order they would have been offered
+  @param n the number of elements in ptrs
+ */
+void priqueue_offer_many(priqueue_t *q, void **ptrs, int n)
+{
+	if(0 >= n){
+		return;
 	}
-	else{
-		node_t *temp = q->front;
-		node_t *prev = NULL;
-		if(DEBUG){
-			printf("Searching for correct position for new value %d...\n", *(int*)ptr);
-		}
+	node_t **sorted = malloc(2 * n * sizeof(node_t *));
+	if(NULL == sorted){
+		fprintf(stderr, "Out of memory.\n");
+		exit(2);
+	}
+	for(int i = 0; i < n; ++i){
+		sorted[i] = node_pool_alloc(&q->pool);
+		sorted[i]->value = ptrs[i];
+		sorted[i]->seq = q->next_seq++;
+	}
+	sort_nodes(q, sorted, sorted + n, n);
 
-		// Two compares in use: 
-		// 	c1(a,b) -> a-b (lowest takes priority)
-		// 	c2(a,b) -> b-a (highest takes priority)
-		while(NULL != temp && 0 >= q->compare(temp->value, ptr)){
-			// proceed until we reach something that has lower
-			// priority or the end
-			if(DEBUG){
-				printf("%d has higher priority than %d...\n", *(int*)temp->value, *(int*)ptr);	
-			}
-			prev = temp;
+	// Merge, moving past every queued element the new one does not beat
+	node_t *temp = q->front;
+	for(int i = 0; i < n; ++i){
+		node_t *node = sorted[i];
+		while(NULL != temp && 0 >= q->compare(temp->value, node->value)){
 			temp = temp->next;
-			insertion_point++;
 		}
-	
-		if(NULL == temp){
-			// case we hit the end
-			temp = malloc(sizeof(node_t));
-			q->back->next = temp;
-			temp->next = NULL;
-			temp->value = ptr;
-			q->size++;
-			q->back = temp;
-			if(DEBUG){
-				printf("Added %d to back\n", *(int*)q->back->value);	
-			}
+		node->next = temp;
+		node->prev = (NULL == temp) ? q->back : temp->prev;
+		if(NULL == node->prev){
+			q->front = node;
 		}
 		else{
-			// case insert a new value
-			node_t *temp2 = malloc(sizeof(node_t));
-			temp2->value = ptr;
-			if(q->front == temp){
-				q->front = temp2;
-				temp2->next = temp;
-			}
-			else{
-				temp2->next = temp;
-				prev->next = temp2;
-			}
-			q->size++;
-			if(DEBUG){
-				printf("Added %d to position %d\n", *(int*)temp2->value, insertion_point);
-			}
+			node->prev->next = node;
 		}
-		if(DEBUG){
-			print_q(q);	
+		if(NULL == temp){
+			q->back = node;
 		}
+		else{
+			temp->prev = node;
+		}
+		q->size++;
 	}
-	return insertion_point;
+	free(sorted);
+}
+
+
+/**
+  Inserts the specified element into this priority queue and returns a handle
+  to it.
+
+  The handle stays valid until the element leaves the queue, and can be given
+  to priqueue_update() or priqueue_remove_handle().
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param ptr a pointer to the data to be inserted into the priority queue
+  @return a handle to the new element
+ */
+node_t *priqueue_offer_handle(priqueue_t *q, void *ptr)
+{
+	node_t *temp = node_pool_alloc(&q->pool);
+	temp->value = ptr;
+	link_node(q, temp);
+	return temp;
+}
+
+
+/**
+  Repositions an element whose priority has changed, as if it had been
+  removed and offered again.  O(n) on this backend.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param handle a handle returned by priqueue_offer_handle()
+ */
+void priqueue_update(priqueue_t *q, node_t *handle)
+{
+	unlink_node(q, handle);
+	link_node(q, handle);
+}
+
+
+/**
+  Compares two queued elements by their position in the queue without
+  walking it.  The comparer decides, and on a tie the element offered first
+  is ahead.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param a a handle returned by priqueue_offer_handle()
+  @param b a handle returned by priqueue_offer_handle()
+  @return non-zero if a comes before b
+ */
+int priqueue_precedes(priqueue_t *q, node_t *a, node_t *b)
+{
+	return precedes(q, a, b);
+}
+
+
+/**
+  Removes the element behind a handle in O(1).  The handle is invalid
+  afterwards.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param handle a handle returned by priqueue_offer_handle()
+  @return the element removed from the queue
+ */
+void *priqueue_remove_handle(priqueue_t *q, node_t *handle)
+{
+	void *ret = handle->value;
+	unlink_node(q, handle);
+	node_pool_release(&q->pool, handle);
+	return ret;
 }
 
 
@@ -177,39 +372,11 @@ void *priqueue_poll(priqueue_t *q)
 		}
 		return NULL;
 	}
-	else if(1 == q->size){
-		if(DEBUG){
-			printf("Removing %d from front of queue...\n", *(int*)q->front->value);	
-			print_q(q);
-		}
-		//node_t* temp = q->front;
-		void *ret = q->front->value;
-		free(q->front);
-		q->front = NULL;
-		q->back = NULL;
-		q->size--;
-		if(DEBUG){
-			print_q(q);
-			//printf("\n\nPlease remember to free this...\n\n");
-		}
-		return ret;
-	}
-	else{
-		if(DEBUG){
-			printf("Removing %d from front of queue...\n", *(int*)q->front->value);
-			print_q(q);
-		}
-		node_t* temp = q->front;
-		void *ret = q->front->value;
-		q->front = q->front->next;
-		free(temp);
-		q->size--;
-		if(DEBUG){
-			print_q(q);
-			//printf("\n\nPlease remember to free this...\n\n");
-		}
-		return ret;
+	if(DEBUG){
+		printf("Removing %d from front of queue...\n", *(int*)q->front->value);
+		print_q(q);
 	}
+	return priqueue_remove_handle(q, q->front);
 }
 
 
@@ -257,6 +424,53 @@ void *priqueue_at(priqueue_t *q, int index)
 }
 
 
+/**
+  Positions a cursor at the front of the queue.  Walking the whole queue with
+  priqueue_iter_next() is O(n), where a priqueue_at() loop is O(n^2).
+
+  @param it the cursor to initialize
+  @param q a pointer to an instance of the priqueue_t data structure
+ */
+void priqueue_iter_init(priqueue_iter_t *it, priqueue_t *q)
+{
+	it->q = q;
+	it->node = q->front;
+	it->reverse = 0;
+}
+
+
+/**
+  Positions a cursor at the back of the queue, to walk it towards the front.
+
+  @param it the cursor to initialize
+  @param q a pointer to an instance of the priqueue_t data structure
+ */
+void priqueue_iter_init_reverse(priqueue_iter_t *it, priqueue_t *q)
+{
+	it->q = q;
+	it->node = q->back;
+	it->reverse = 1;
+}
+
+
+/**
+  Returns the element under the cursor and moves the cursor along.
+
+  @param it a cursor set up by priqueue_iter_init or priqueue_iter_init_reverse
+  @return the next element
+  @return NULL if the cursor has run off the end of the queue
+ */
+void *priqueue_iter_next(priqueue_iter_t *it)
+{
+	node_t *temp = it->node;
+	if(NULL == temp){
+		return NULL;
+	}
+	it->node = it->reverse ? temp->prev : temp->next;
+	return temp->value;
+}
+
+
 /**
   Removes all instances of ptr from the queue. 
   
@@ -270,53 +484,21 @@ void *priqueue_at(priqueue_t *q, int index)
 int priqueue_remove(priqueue_t *q, void *ptr)
 {
 	node_t* temp = q->front;
-	node_t* prev = NULL;
+	node_t* next;
 	int removed = 0;
 	while(NULL != temp){
+		next = temp->next;
 		if(temp->value == ptr){
-			// Remove
 			if(DEBUG){
 				printf("Destroying match for %d\n", *(int*)ptr);
-				print_q(q);
-				printf("\n\nFREEING!\n\n");
-			}
-			if(1 == q->size){
-				free(temp);
-				q->front = NULL;
-				q->back = NULL;
-			}
-			else if(temp == q->front){
-				prev = temp;
-				temp = temp->next;
-				q->front = temp;
-				free(prev);
-				prev = NULL;
-			}
-			else if(temp == q->back){
-				free(temp);
-				temp = NULL;
-				q->back = prev;
-				q->back->next=NULL;
-			}
-			else{
-				node_t* destroy = temp;
-				temp = temp->next;
-				free(destroy);
-				prev->next = temp;
 			}
+			priqueue_remove_handle(q, temp);
 			removed++;
-			q->size--;
-			if(DEBUG){
-				print_q(q);
-			}
 		}
-		else{
-			if(DEBUG){
-				printf("%d does not match pattern %d, moving on...\n", *(int*)temp->value, *(int*)ptr);	
-			}
-			prev = temp;
-			temp = temp->next;
+		else if(DEBUG){
+			printf("%d does not match pattern %d, moving on...\n", *(int*)temp->value, *(int*)ptr);	
 		}
+		temp = next;
 	}
 	return removed;
 }
@@ -333,40 +515,16 @@ int priqueue_remove(priqueue_t *q, void *ptr)
  */
 void *priqueue_remove_at(priqueue_t *q, int index)
 {
-	if(NULL == q || 0 == q->size || q->size < index ){
+	if(NULL == q || 0 > index || q->size <= index ){
 		return NULL;
 	}
 	int count = 0;
-	void *ret = NULL;
 	node_t *temp = q->front;
-	node_t * prev = NULL;
 	while(count != index){
-		prev = temp;
 		temp = temp->next;
 		count++;
 	}
-	if(1 == q->size){	// Case exactly one
-		ret = (void *)temp->value;
-		q->front = NULL;
-		q->back = NULL;
-	}
-	else if(temp == q->back){	// Case remove from back
-		prev->next = NULL;
-		q->back = prev;
-		ret = (void *)temp->value;
-	}
-	else if(temp == q->front){	// Case remove from front
-		q->front = temp->next;
-		ret = (void*)temp->value;
-	}
-	else{	// Case remove from middle
-		prev->next = temp->next;
-		ret = (void*)temp->value;
-	}
-	free(temp);
-	q->size--;
-	return ret;
-
+	return priqueue_remove_handle(q, temp);
 }
 
 
@@ -389,15 +547,9 @@ int priqueue_size(priqueue_t *q)
  */
 void priqueue_destroy(priqueue_t *q)
 {
-	node_t *temp;
-	while(q->front != NULL){
-		temp = q->front->next;
-		free(q->front);
-		q->front = temp;
-		q->size--;
-	}
-	assert(0 == q->size);
+	// Every node lives in the pool, so there is nothing to walk
+	node_pool_destroy(&q->pool);
 	q->front = NULL;
 	q->back = NULL;
+	q->size = 0;
 }
-
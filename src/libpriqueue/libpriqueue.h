@@ -6,14 +6,96 @@
 #include <assert.h>
 
 
+/*
+ * Two interchangeable backends implement the API below.  The default is a
+ * sorted doubly linked list (libpriqueue.c).  Building with PRIQUEUE_HEAP
+ * defined (make PRIQUEUE=heap) swaps in an array-backed binary heap
+ * (libpriqueue_heap.c) with O(log n) offer and poll.
+ *
+ * A node_t * returned by priqueue_offer_handle is an opaque handle on either
+ * backend.
+ *
+ * Every element is stamped with an insertion sequence number when it is
+ * offered.  Elements the comparer ranks equal come out in sequence order, so
+ * a comparer only needs to return 0 on a tie to get FIFO behaviour.
+ */
+#ifdef PRIQUEUE_HEAP
+
+/**
+ * Node data structure
+ */
+typedef struct node_t{
+	void *value;
+
+	// Insertion order, used to keep equal elements FIFO
+	unsigned long seq;
+
+	// Current position of this node in the heap array
+	int index;
+} node_t;
+
+#else
+
 /**
  * Node data structure
  */
 typedef struct node_t{
 	void *value;
+
+	// Insertion order, used to keep equal elements FIFO
+	unsigned long seq;
+
 	struct node_t *next;
+	struct node_t *prev;
 } node_t;
 
+#endif /* PRIQUEUE_HEAP */
+
+
+/**
+ * Slab allocator for the nodes of one queue, see libpriqueue_pool.c
+ */
+typedef struct _node_pool_t
+{
+	// Chain of slabs, all freed together on destroy
+	void *slabs;
+
+	// Recycled nodes
+	node_t *free;
+
+	// Untouched nodes left at the end of the newest slab
+	node_t *bump;
+	int bump_left;
+
+	// Number of nodes in the next slab
+	int slab_size;
+
+} node_pool_t;
+
+
+#ifdef PRIQUEUE_HEAP
+
+/**
+ * Priority queue data structure
+ */
+typedef struct _priqueue_t
+{
+	node_t **heap;
+	int capacity;
+	int size;
+	unsigned long next_seq;
+
+	// In-order copy of the heap backing priqueue_at, rebuilt lazily
+	node_t **sorted;
+	int sorted_valid;
+
+	node_pool_t pool;
+
+	int (*compare)(const void *, const void *);
+
+} priqueue_t;
+
+#else
 
 /**
  * Priority queue data structure
@@ -23,10 +105,36 @@ typedef struct _priqueue_t
 	node_t *front;
 	node_t * back;
 	int size;
+	unsigned long next_seq;
+	node_pool_t pool;
 	int (*compare)(const void *, const void *);
 
 } priqueue_t;
 
+#endif /* PRIQUEUE_HEAP */
+
+
+/**
+ * Cursor over the elements of a queue in priority order.  The queue must not
+ * be changed while a cursor is in use, other than through the elements'
+ * own data.
+ */
+typedef struct _priqueue_iter_t
+{
+	priqueue_t *q;
+
+#ifdef PRIQUEUE_HEAP
+	// Next position in q->sorted, and +1 or -1 for the direction
+	int index;
+	int step;
+#else
+	// Next node to visit, and non-zero when walking towards the front
+	node_t *node;
+	int reverse;
+#endif
+
+} priqueue_iter_t;
+
 /**
  * @brief Initializer for a priority queue element, called once immediately
  * after creating it.
@@ -38,6 +146,13 @@ typedef struct _priqueue_t
 void   priqueue_init     (priqueue_t *q, int(*comparer)(const void *, const void *));
 
 
+/**
+ * @brief Same as priqueue_init, but sets aside room for capacity elements up
+ * front so the first capacity offers do not allocate.
+ */
+void   priqueue_init_capacity(priqueue_t *q, int(*comparer)(const void *, const void *), int capacity);
+
+
 /**
  * @brief Inserts the value at the given address into this queue, and returns
  * the value of the index it was inserted at.
@@ -45,6 +160,40 @@ void   priqueue_init     (priqueue_t *q, int(*comparer)(const void *, const void
 int    priqueue_offer    (priqueue_t *q, void *ptr);
 
 
+/**
+ * @brief Inserts n values at once, leaving the queue in the same order as n
+ * calls to priqueue_offer would
+ */
+void   priqueue_offer_many(priqueue_t *q, void **ptrs, int n);
+
+
+/**
+ * @brief Inserts the value like priqueue_offer, and returns a handle to it
+ * that stays valid until the element leaves the queue.
+ */
+node_t *priqueue_offer_handle(priqueue_t *q, void *ptr);
+
+
+/**
+ * @brief Repositions the element behind handle after its priority changed,
+ * as if it had been removed and offered again
+ */
+void   priqueue_update   (priqueue_t *q, node_t *handle);
+
+
+/**
+ * @brief Returns non-zero if the element behind handle a is ahead of the one
+ * behind handle b in queue order, counting insertion order on ties
+ */
+int    priqueue_precedes (priqueue_t *q, node_t *a, node_t *b);
+
+
+/**
+ * @brief Removes and returns the element behind handle
+ */
+void * priqueue_remove_handle(priqueue_t *q, node_t *handle);
+
+
 /**
  * @brief Returns the value of the frontmost element in the queue
  */
@@ -65,6 +214,26 @@ void * priqueue_poll     (priqueue_t *q);
 void * priqueue_at       (priqueue_t *q, int index);
 
 
+/**
+ * @brief Positions a cursor before the frontmost element
+ */
+void   priqueue_iter_init(priqueue_iter_t *it, priqueue_t *q);
+
+
+/**
+ * @brief Positions a cursor after the backmost element, so that it walks
+ * from the back of the queue to the front
+ */
+void   priqueue_iter_init_reverse(priqueue_iter_t *it, priqueue_t *q);
+
+
+/**
+ * @brief Returns the next element under the cursor and advances it, or NULL
+ * once every element has been visited
+ */
+void * priqueue_iter_next(priqueue_iter_t *it);
+
+
 /**
  * @brief Remove all elements with the given value at ptr
  */
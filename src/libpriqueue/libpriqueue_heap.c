@@ -0,0 +1,535 @@
+/** @file libpriqueue_heap.c
+ *
+ *  Binary heap implementation of the priority queue.  Built instead of
+ *  libpriqueue.c when PRIQUEUE_HEAP is defined (make PRIQUEUE=heap).
+ *
+ *  The heap holds pointers to nodes so that a node keeps its identity while
+ *  it is sifted around.  Every node is stamped with its insertion order,
+ *  which is used to reproduce the FIFO-on-tie behavior of the list backend.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "libpriqueue.h"
+#include "libpriqueue_pool.h"
+
+#define DEBUG 0
+
+#define PARENT(i)	(((i) - 1) / 2)
+#define LEFT(i)		(2 * (i) + 1)
+
+
+/**
+ * @brief Decides whether node a belongs in front of node b
+ *
+ * The comparer decides, and the insertion sequence settles ties: a comparer
+ * returns 0 on a tie, as comparison_RR does for every pair, and the older
+ * element comes out first.  This is the order the list backend produces,
+ * which keeps an older element in front of a newer one whenever
+ * compare(older, newer) <= 0.
+ *
+ * @return non-zero if a should be polled before b
+ */
+static int precedes(priqueue_t *q, node_t *a, node_t *b){
+	if(a->seq < b->seq){
+		return 0 >= q->compare(a->value, b->value);
+	}
+	return 0 < q->compare(b->value, a->value);
+}
+
+
+/**
+ * @brief Moves the node at position i up until its parent precedes it
+ *
+ * @param track non-zero if node->index should follow the node, which is only
+ * 		the case for q->heap itself
+ */
+static void sift_up(priqueue_t *q, node_t **a, int i, int track){
+	node_t *temp = a[i];
+	while(0 < i && precedes(q, temp, a[PARENT(i)])){
+		a[i] = a[PARENT(i)];
+		if(track){
+			a[i]->index = i;
+		}
+		i = PARENT(i);
+	}
+	a[i] = temp;
+	if(track){
+		temp->index = i;
+	}
+}
+
+
+/**
+ * @brief Moves the node at position i down until it precedes its children
+ *
+ * @param n the number of valid entries in a
+ * @param track non-zero if node->index should follow the node
+ */
+static void sift_down(priqueue_t *q, node_t **a, int n, int i, int track){
+	node_t *temp = a[i];
+	int child;
+	while((child = LEFT(i)) < n){
+		if(child + 1 < n && precedes(q, a[child + 1], a[child])){
+			child++;
+		}
+		if(!precedes(q, a[child], temp)){
+			break;
+		}
+		a[i] = a[child];
+		if(track){
+			a[i]->index = i;
+		}
+		i = child;
+	}
+	a[i] = temp;
+	if(track){
+		temp->index = i;
+	}
+}
+
+
+/**
+ * @brief Restores the heap property over the whole array in O(n)
+ */
+static void heapify(priqueue_t *q){
+	for(int i = 0; i < q->size; ++i){
+		q->heap[i]->index = i;
+	}
+	for(int i = q->size / 2 - 1; i >= 0; --i){
+		sift_down(q, q->heap, q->size, i, 1);
+	}
+	q->sorted_valid = 0;
+}
+
+
+/**
+ * @brief Resizes the heap and sorted arrays to hold capacity nodes
+ */
+static void reserve(priqueue_t *q, int capacity){
+	q->capacity = capacity;
+	q->heap = realloc(q->heap, q->capacity * sizeof(node_t *));
+	q->sorted = realloc(q->sorted, q->capacity * sizeof(node_t *));
+	if(NULL == q->heap || NULL == q->sorted){
+		fprintf(stderr, "Out of memory.\n");
+		exit(2);
+	}
+}
+
+
+/**
+ * @brief Makes sure there is room for at least one more node
+ */
+static void grow(priqueue_t *q){
+	if(q->size < q->capacity){
+		return;
+	}
+	reserve(q, (0 == q->capacity) ? 16 : 2 * q->capacity);
+}
+
+
+/**
+ * @brief Rebuilds the in-order view used by priqueue_at, if it is stale
+ *
+ * Heap-sorts a copy of the heap, which leaves the nodes in reverse order,
+ * then flips it around.
+ */
+static void build_sorted(priqueue_t *q){
+	if(q->sorted_valid){
+		return;
+	}
+	for(int i = 0; i < q->size; ++i){
+		q->sorted[i] = q->heap[i];
+	}
+	for(int n = q->size - 1; n > 0; --n){
+		node_t *temp = q->sorted[0];
+		q->sorted[0] = q->sorted[n];
+		q->sorted[n] = temp;
+		sift_down(q, q->sorted, n, 0, 0);
+	}
+	for(int i = 0, j = q->size - 1; i < j; ++i, --j){
+		node_t *temp = q->sorted[i];
+		q->sorted[i] = q->sorted[j];
+		q->sorted[j] = temp;
+	}
+	q->sorted_valid = 1;
+}
+
+
+/**
+ * @brief Unlinks the given node from the heap and returns it to the pool
+ *
+ * @return the value the node carried
+ */
+static void *delete_node(priqueue_t *q, node_t *node){
+	void *ret = node->value;
+	int i = node->index;
+	node_t *last = q->heap[--q->size];
+	if(i != q->size){
+		q->heap[i] = last;
+		last->index = i;
+		sift_up(q, q->heap, i, 1);
+		sift_down(q, q->heap, q->size, last->index, 1);
+	}
+	node_pool_release(&q->pool, node);
+	q->sorted_valid = 0;
+	return ret;
+}
+
+
+/**
+  Initializes the priqueue_t data structure.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param comparer a function pointer that compares two elements.
+  See also @ref comparer-page
+ */
+void priqueue_init(priqueue_t *q, int(*comparer)(const void *, const void *))
+{
+	priqueue_init_capacity(q, comparer, 0);
+}
+
+
+/**
+  Initializes the priqueue_t data structure with room for capacity elements.
+
+  Both the heap array and the nodes are sized up front.  Nodes are recycled
+  through a pool owned by the queue, so offer and poll stop allocating once
+  the queue has reached its working size.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param comparer a function pointer that compares two elements.
+  @param capacity number of elements to preallocate, or 0 to allocate on
+  	 demand
+ */
+void priqueue_init_capacity(priqueue_t *q, int(*comparer)(const void *, const void *), int capacity)
+{
+	q->heap = NULL;
+	q->sorted = NULL;
+	q->capacity = 0;
+	q->size = 0;
+	q->next_seq = 0;
+	q->sorted_valid = 1;
+	q->compare = comparer;
+	node_pool_init(&q->pool, capacity);
+	if(0 < capacity){
+		reserve(q, capacity);
+	}
+}
+
+
+/**
+  Inserts the specified element into this priority queue in O(log n).
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param ptr a pointer to the data to be inserted into the priority queue
+  @return The zero-based heap slot where ptr ended up.  Unlike the list
+  	  backend this is not its position in priority order.
+ */
+int priqueue_offer(priqueue_t *q, void *ptr)
+{
+	return priqueue_offer_handle(q, ptr)->index;
+}
+
+
+/**
+  Inserts n elements at once.
+
+  When the batch is at least as large as the queue, the nodes are appended and
+  the whole array is re-heapified in O(m + n).  Smaller batches are sifted in
+  one at a time.  Either way the nodes get consecutive sequence numbers, so the
+  result polls in the same order as n calls to priqueue_offer.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param ptrs the elements to insert, in the order they would have been offered
+  @param n the number of elements in ptrs
+ */
+void priqueue_offer_many(priqueue_t *q, void **ptrs, int n)
+{
+	if(0 >= n){
+		return;
+	}
+	if(q->size + n > q->capacity){
+		reserve(q, q->size + n);
+	}
+	int bulk = (n >= q->size);
+	for(int i = 0; i < n; ++i){
+		node_t *temp = node_pool_alloc(&q->pool);
+		temp->value = ptrs[i];
+		temp->seq = q->next_seq++;
+		q->heap[q->size] = temp;
+		if(!bulk){
+			sift_up(q, q->heap, q->size, 1);
+		}
+		q->size++;
+	}
+	if(bulk){
+		heapify(q);
+	}
+	q->sorted_valid = 0;
+}
+
+
+/**
+  Inserts the specified element into this priority queue in O(log n) and
+  returns a handle to it.
+
+  The handle stays valid until the element leaves the queue, and can be given
+  to priqueue_update() or priqueue_remove_handle().
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param ptr a pointer to the data to be inserted into the priority queue
+  @return a handle to the new element
+ */
+node_t *priqueue_offer_handle(priqueue_t *q, void *ptr)
+{
+	grow(q);
+
+	node_t *temp = node_pool_alloc(&q->pool);
+	temp->value = ptr;
+	temp->seq = q->next_seq++;
+
+	q->heap[q->size] = temp;
+	sift_up(q, q->heap, q->size, 1);
+	q->size++;
+	q->sorted_valid = 0;
+
+	if(DEBUG){
+		printf("Added a value at heap slot %d\n", temp->index);
+	}
+	return temp;
+}
+
+
+/**
+  Repositions an element whose priority has changed, as if it had been
+  removed and offered again.  O(log n).
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param handle a handle returned by priqueue_offer_handle()
+ */
+void priqueue_update(priqueue_t *q, node_t *handle)
+{
+	// A fresh sequence number puts it behind the elements it ties with
+	handle->seq = q->next_seq++;
+	sift_up(q, q->heap, handle->index, 1);
+	sift_down(q, q->heap, q->size, handle->index, 1);
+	q->sorted_valid = 0;
+}
+
+
+/**
+  Compares two queued elements by their position in the queue without
+  walking it.  The comparer decides, and on a tie the element offered first
+  is ahead.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param a a handle returned by priqueue_offer_handle()
+  @param b a handle returned by priqueue_offer_handle()
+  @return non-zero if a comes before b
+ */
+int priqueue_precedes(priqueue_t *q, node_t *a, node_t *b)
+{
+	return precedes(q, a, b);
+}
+
+
+/**
+  Removes the element behind a handle in O(log n).  The handle is invalid
+  afterwards.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param handle a handle returned by priqueue_offer_handle()
+  @return the element removed from the queue
+ */
+void *priqueue_remove_handle(priqueue_t *q, node_t *handle)
+{
+	return delete_node(q, handle);
+}
+
+
+/**
+  Retrieves, but does not remove, the head of this queue, returning NULL if
+  this queue is empty.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @return pointer to element at the head of the queue
+  @return NULL if the queue is empty
+ */
+void *priqueue_peek(priqueue_t *q)
+{
+	if(0 == q->size){
+		return NULL;
+	}
+	return q->heap[0]->value;
+}
+
+
+/**
+  Retrieves and removes the head of this queue in O(log n), or NULL if this
+  queue is empty.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @return the head of this queue
+  @return NULL if this queue is empty
+ */
+void *priqueue_poll(priqueue_t *q)
+{
+	if(0 == q->size){
+		return NULL;
+	}
+	return delete_node(q, q->heap[0]);
+}
+
+
+/**
+  Returns the element at the specified position in priority order, or NULL if
+  the queue does not contain an index'th element.
+
+  @note The first call after the queue changes sorts a copy of the heap, so a
+  	full pass over the queue costs O(n log n) rather than O(n^2).
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param index position of retrieved element
+  @return the index'th element in the queue
+  @return NULL if the queue does not contain the index'th element
+ */
+void *priqueue_at(priqueue_t *q, int index)
+{
+	if(index > q->size){
+		printf("INVALID SIZE\n");
+	}
+	else if(0 <= index && index < q->size){
+		build_sorted(q);
+		return q->sorted[index]->value;
+	}
+	return NULL;
+}
+
+
+/**
+  Positions a cursor at the front of the queue.  The in-order view is
+  refreshed once here, so the walk itself is O(n).
+
+  @param it the cursor to initialize
+  @param q a pointer to an instance of the priqueue_t data structure
+ */
+void priqueue_iter_init(priqueue_iter_t *it, priqueue_t *q)
+{
+	build_sorted(q);
+	it->q = q;
+	it->index = 0;
+	it->step = 1;
+}
+
+
+/**
+  Positions a cursor at the back of the queue, to walk it towards the front.
+
+  @param it the cursor to initialize
+  @param q a pointer to an instance of the priqueue_t data structure
+ */
+void priqueue_iter_init_reverse(priqueue_iter_t *it, priqueue_t *q)
+{
+	build_sorted(q);
+	it->q = q;
+	it->index = q->size - 1;
+	it->step = -1;
+}
+
+
+/**
+  Returns the element under the cursor and moves the cursor along.
+
+  @param it a cursor set up by priqueue_iter_init or priqueue_iter_init_reverse
+  @return the next element
+  @return NULL if the cursor has run off the end of the queue
+ */
+void *priqueue_iter_next(priqueue_iter_t *it)
+{
+	if(0 > it->index || it->q->size <= it->index){
+		return NULL;
+	}
+	void *ret = it->q->sorted[it->index]->value;
+	it->index += it->step;
+	return ret;
+}
+
+
+/**
+  Removes all instances of ptr from the queue.
+
+  Matching nodes are dropped in a single pass and the survivors are
+  re-heapified, so this is O(n) no matter how many entries match.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param ptr address of element to be removed
+  @return the number of entries removed
+ */
+int priqueue_remove(priqueue_t *q, void *ptr)
+{
+	int kept = 0;
+	int removed = 0;
+	for(int i = 0; i < q->size; ++i){
+		if(q->heap[i]->value == ptr){
+			node_pool_release(&q->pool, q->heap[i]);
+			removed++;
+		}
+		else{
+			q->heap[kept++] = q->heap[i];
+		}
+	}
+	if(removed){
+		q->size = kept;
+		heapify(q);
+	}
+	return removed;
+}
+
+
+/**
+  Removes the element at the given position in priority order.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param index position of element to be removed
+  @return the element removed from the queue
+  @return NULL if the specified index does not exist
+ */
+void *priqueue_remove_at(priqueue_t *q, int index)
+{
+	if(NULL == q || 0 > index || q->size <= index){
+		return NULL;
+	}
+	build_sorted(q);
+	return delete_node(q, q->sorted[index]);
+}
+
+
+/**
+  Returns the number of elements in the queue.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @return the number of elements in the queue
+ */
+int priqueue_size(priqueue_t *q)
+{
+	return q->size;
+}
+
+
+/**
+  Destroys and frees all the memory associated with q.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+ */
+void priqueue_destroy(priqueue_t *q)
+{
+	node_pool_destroy(&q->pool);
+	free(q->heap);
+	free(q->sorted);
+	q->heap = NULL;
+	q->sorted = NULL;
+	q->capacity = 0;
+	q->size = 0;
+}
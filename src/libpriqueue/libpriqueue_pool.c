@@ -0,0 +1,121 @@
+/** @file libpriqueue_pool.c
+ *
+ *  Slab allocator for priority queue nodes.  Each priqueue_t owns one pool,
+ *  so offer/poll only touch the system allocator when the queue grows past
+ *  every size it has reached before.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "libpriqueue_pool.h"
+
+#define DEBUG 0
+
+// Nodes in the first slab when no capacity hint was given, and the point at
+// which slabs stop doubling
+#define POOL_MIN_SLAB	16
+#define POOL_MAX_SLAB	4096
+
+
+/**
+ * Header placed in front of the nodes of every slab
+ */
+typedef struct _node_slab_t{
+	struct _node_slab_t *next;
+	node_t nodes[];
+} node_slab_t;
+
+
+/**
+ * @brief Allocates a new slab of count nodes and makes it the bump region
+ */
+static void add_slab(node_pool_t *pool, int count){
+	node_slab_t *slab = malloc(sizeof(node_slab_t) + count * sizeof(node_t));
+	if(NULL == slab){
+		fprintf(stderr, "Out of memory.\n");
+		exit(2);
+	}
+	slab->next = pool->slabs;
+	pool->slabs = slab;
+	pool->bump = slab->nodes;
+	pool->bump_left = count;
+
+	if(DEBUG){
+		printf("Added slab of %d nodes\n", count);
+	}
+
+	// Grow geometrically so a large queue needs few slabs
+	pool->slab_size = (2 * count < POOL_MAX_SLAB) ? 2 * count : POOL_MAX_SLAB;
+}
+
+
+/**
+  Sets up an empty pool.
+
+  @param pool the pool to initialize
+  @param capacity number of nodes to preallocate, or 0 to allocate lazily
+ */
+void node_pool_init(node_pool_t *pool, int capacity){
+	pool->slabs = NULL;
+	pool->free = NULL;
+	pool->bump = NULL;
+	pool->bump_left = 0;
+	pool->slab_size = POOL_MIN_SLAB;
+	if(0 < capacity){
+		add_slab(pool, capacity);
+	}
+}
+
+
+/**
+  Hands out a node.  Released nodes are reused first, then the unused tail of
+  the newest slab, and only then is a new slab allocated.
+
+  @param pool the pool to allocate from
+  @return an uninitialized node
+ */
+node_t *node_pool_alloc(node_pool_t *pool){
+	node_t *node;
+	if(NULL != pool->free){
+		node = pool->free;
+		pool->free = (node_t *)node->value;
+		return node;
+	}
+	if(0 == pool->bump_left){
+		add_slab(pool, pool->slab_size);
+	}
+	node = pool->bump++;
+	pool->bump_left--;
+	return node;
+}
+
+
+/**
+  Returns a node to the pool.  Free nodes are chained through their value
+  field, which is meaningless once the node has left its queue.
+
+  @param pool the pool the node came from
+  @param node the node to recycle
+ */
+void node_pool_release(node_pool_t *pool, node_t *node){
+	node->value = pool->free;
+	pool->free = node;
+}
+
+
+/**
+  Releases all memory held by the pool in one pass over its slabs.
+
+  @param pool the pool to tear down
+ */
+void node_pool_destroy(node_pool_t *pool){
+	node_slab_t *slab = pool->slabs;
+	node_slab_t *next;
+	while(NULL != slab){
+		next = slab->next;
+		free(slab);
+		slab = next;
+	}
+	node_pool_init(pool, 0);
+}
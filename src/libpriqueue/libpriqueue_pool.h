@@ -0,0 +1,33 @@
+/** @file libpriqueue_pool.h
+ *
+ *  Node allocator shared by the priority queue backends.  Not part of the
+ *  public priqueue API.
+ */
+
+#ifndef LIBPRIQUEUE_POOL_H_
+#define LIBPRIQUEUE_POOL_H_
+
+#include "libpriqueue.h"
+
+/**
+ * @brief Sets up an empty pool, preallocating room for capacity nodes if
+ * capacity is positive
+ */
+void    node_pool_init   (node_pool_t *pool, int capacity);
+
+/**
+ * @brief Hands out a node, recycling a released one when possible
+ */
+node_t *node_pool_alloc  (node_pool_t *pool);
+
+/**
+ * @brief Returns a node to the pool for reuse
+ */
+void    node_pool_release(node_pool_t *pool, node_t *node);
+
+/**
+ * @brief Frees every slab at once, invalidating all nodes from this pool
+ */
+void    node_pool_destroy(node_pool_t *pool);
+
+#endif /* LIBPRIQUEUE_POOL_H_ */
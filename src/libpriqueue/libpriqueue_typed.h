@@ -0,0 +1,132 @@
+/** @file libpriqueue_typed.h
+ *
+ *  Type-specialized priority queue, generated per element type.
+ *
+ *  PRIQUEUE_DEFINE(name, elem_t, key_t, key_of, key_cmp) expands to a binary
+ *  heap called name_t holding elem_t pointers, together with static inline
+ *  functions name_init, name_offer, name_peek, name_poll, name_size and
+ *  name_destroy.
+ *
+ *  Each entry stores key_of(elem) next to the element pointer, so sifting
+ *  reads only the heap array and never dereferences the elements.  key_cmp
+ *  is called directly and can be inlined, where priqueue_t has to go through
+ *  a function pointer on void *.  The generic priqueue_t API is unchanged
+ *  and remains the right choice for mixed types or comparers that look at
+ *  state that changes while an element is queued.
+ *
+ *  key_of takes a const elem_t * and returns a key_t.  key_cmp takes two
+ *  const key_t * and returns a negative, zero or positive int like the
+ *  priqueue comparers.  Equal keys come out in FIFO order.
+ *
+ *  Example:
+ *
+ *    static inline int job_key(const job_t *j){ return j->priority; }
+ *    static inline int int_cmp(const int *a, const int *b){ return *a - *b; }
+ *    PRIQUEUE_DEFINE(jobq, job_t, int, job_key, int_cmp)
+ *
+ *    jobq_t q;
+ *    jobq_init(&q, 0);
+ *    jobq_offer(&q, job);
+ */
+
+#ifndef LIBPRIQUEUE_TYPED_H_
+#define LIBPRIQUEUE_TYPED_H_
+
+#include <stdlib.h>
+#include <stdio.h>
+
+#define PRIQUEUE_DEFINE(name, elem_t, key_t, key_of, key_cmp)			\
+										\
+typedef struct name##_entry_t{							\
+	key_t key;								\
+	unsigned long seq;							\
+	elem_t *elem;								\
+} name##_entry_t;								\
+										\
+typedef struct name##_t{							\
+	name##_entry_t *heap;							\
+	int size;								\
+	int capacity;								\
+	unsigned long next_seq;							\
+} name##_t;									\
+										\
+static inline int name##_precedes(const name##_entry_t *a,			\
+				  const name##_entry_t *b){			\
+	int c = key_cmp(&a->key, &b->key);					\
+	return 0 > c || (0 == c && a->seq < b->seq);				\
+}										\
+										\
+static inline void name##_reserve(name##_t *q, int capacity){			\
+	q->capacity = capacity;							\
+	q->heap = realloc(q->heap, capacity * sizeof(name##_entry_t));		\
+	if(NULL == q->heap){							\
+		fprintf(stderr, "Out of memory.\n");				\
+		exit(2);							\
+	}									\
+}										\
+										\
+static inline void name##_init(name##_t *q, int capacity){			\
+	q->heap = NULL;								\
+	q->size = 0;								\
+	q->capacity = 0;							\
+	q->next_seq = 0;							\
+	if(0 < capacity){							\
+		name##_reserve(q, capacity);					\
+	}									\
+}										\
+										\
+static inline void name##_offer(name##_t *q, elem_t *elem){			\
+	if(q->size == q->capacity){						\
+		name##_reserve(q, (0 == q->capacity) ? 16 : 2 * q->capacity);	\
+	}									\
+	name##_entry_t temp;							\
+	temp.key = key_of(elem);						\
+	temp.seq = q->next_seq++;						\
+	temp.elem = elem;							\
+	int i = q->size++;							\
+	while(0 < i && name##_precedes(&temp, &q->heap[(i - 1) / 2])){		\
+		q->heap[i] = q->heap[(i - 1) / 2];				\
+		i = (i - 1) / 2;						\
+	}									\
+	q->heap[i] = temp;							\
+}										\
+										\
+static inline elem_t *name##_peek(name##_t *q){					\
+	return (0 == q->size) ? NULL : q->heap[0].elem;				\
+}										\
+										\
+static inline elem_t *name##_poll(name##_t *q){					\
+	if(0 == q->size){							\
+		return NULL;							\
+	}									\
+	elem_t *ret = q->heap[0].elem;						\
+	name##_entry_t temp = q->heap[--q->size];				\
+	int i = 0;								\
+	int child;								\
+	while((child = 2 * i + 1) < q->size){					\
+		if(child + 1 < q->size &&					\
+		   name##_precedes(&q->heap[child + 1], &q->heap[child])){	\
+			child++;						\
+		}								\
+		if(!name##_precedes(&q->heap[child], &temp)){			\
+			break;							\
+		}								\
+		q->heap[i] = q->heap[child];					\
+		i = child;							\
+	}									\
+	q->heap[i] = temp;							\
+	return ret;								\
+}										\
+										\
+static inline int name##_size(name##_t *q){					\
+	return q->size;								\
+}										\
+										\
+static inline void name##_destroy(name##_t *q){					\
+	free(q->heap);								\
+	q->heap = NULL;								\
+	q->size = 0;								\
+	q->capacity = 0;							\
+}
+
+#endif /* LIBPRIQUEUE_TYPED_H_ */
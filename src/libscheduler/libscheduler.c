@@ -10,57 +10,348 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include "libscheduler.h"
-#include "../libpriqueue/libpriqueue.h"
+#include "../libpriqueue/libbucketq.h"
+#include "../libpriqueue/libpriqueue_typed.h"
 
 #define DEBUG 0
 
+// Under PRI and PPRI, jobs with priorities 0 to PRI_BUCKETS-1 wait in a
+// bucket queue.  A job outside that range sends the scheduler back to
+// runnable_q for the rest of the run.
+#ifndef PRI_BUCKETS
+#define PRI_BUCKETS 64
+#endif
+
+// Number of MLFQ levels, the quantum of level l in quanta of the simulator
+// (1 << l), and the period in time units at which every job is boosted
+// back to level 0
+#ifndef MLFQ_LEVELS
+#define MLFQ_LEVELS 3
+#endif
+#ifndef MLFQ_BOOST
+#define MLFQ_BOOST 50
+#endif
+
+// CFS target latency, the time in quanta of the simulator within which
+// every runnable job should get a turn, and the shortest slice a job gets
+// however many are runnable
+#ifndef CFS_LATENCY
+#define CFS_LATENCY 12
+#endif
+#ifndef CFS_MIN_GRANULARITY
+#define CFS_MIN_GRANULARITY 1
+#endif
+
+// CFS weight of a job with priority 0.  A job with this weight gains one
+// unit of virtual runtime per time unit it runs.
+#define CFS_NICE0_WEIGHT 1024
+
+// Jobs in the first job slab, and the point at which job slabs stop doubling
+#define JOB_MIN_SLAB	16
+#define JOB_MAX_SLAB	4096
 
-// Global ready queue
-priqueue_t *ready_q;
 
+/**
+  Stores what the comparators and the time sweeps read about a job to be
+  scheduled.  Padded and aligned to one 64 byte cache line, and job slabs
+  are allocated on a cache line boundary, so every record sits in exactly
+  one line.  Statistics that are only needed when the job finishes live in
+  job_stats_t.
+*/
+typedef struct _job_t{
+
+	// Job number, unique among the jobs of a scheduler
+	int number;
+
+	// Negative if unassigned, otherwise the integer corresponding to the
+	// core in active_core
+	int core;
+
+	// Time units still to run, the key under SJF and PSJF
+	int remaining;
+
+	// The key under PRI and PPRI, lower runs first
+	int priority;
+
+	// Time this job was last put on a core or accounted for, -1 while it
+	// is not running
+	int last_active;
+
+	// Position in arrival order, breaks ties inside a waiting_q bucket
+	int arrival_order;
+
+	// Index of this job's statistics in stats, fixed for as long as the
+	// record lives in its slab
+	int slot;
+
+	union{
+		// Position in the running heap while this job is on a core, under
+		// PSJF and PPRI
+		int running_index;
+
+		// Quanta this job has used up at its level under MLFQ, or of its
+		// slice under CFS
+		int quanta_used;
+	};
+
+	// Next record in the free list once the job is retired
+	struct _job_t *next_free;
 
-// Track busy cores
-int *active_core;
-int NUM_CORES;
+	union{
+		// This job's entry in waiting_q while it waits for a core
+		bucket_node_t *waiting;
 
+		// Next job in its run list while it waits for a core, under RR
+		// and MLFQ
+		struct _job_t *run_next;
+	};
 
-// Keep track of scheme
-scheme_t policy;
+	// Core whose run queue holds this job under PER_CORE_QUEUES
+	int home;
+
+	union{
+		// MLFQ level, 0 being the most important
+		int level;
+
+		// Weighted time this job has run under CFS, the key of
+		// cfs_q.  Compared modulo 2^32, so it may wrap.
+		int vruntime;
+
+		// Key of the policy while this job waits in runnable_q, under
+		// FCFS, SJF, PSJF, PRI and PPRI
+		int rank;
+	};
+
+} __attribute__((aligned(64))) job_t;
+
+_Static_assert(64 == sizeof(job_t), "job_t must fill exactly one cache line");
 
 
 /**
-  Stores information making up a job to be scheduled  and statistics required
-  for the scheduler and its helper functions.
+  Statistics of a job, only read when it finishes.
 */
-typedef struct _job_t{
+typedef struct _job_stats_t{
 
-	// Contains in order: uuid, arrival, burst, priority, runtime, end,
-	// last active time, latency
-	int value[8];
+	// Time the job arrived
+	int arrival;
 
-	// Negative if unassigned, otherwise the integer corresponding to the
-	// core in active_core
-	int core;
+	// Time units the job needs in total
+	int burst;
 
-	// Flag for completion
-	int finished;
+	// Time from arrival until the job first ran, -1 until then
+	int latency;
 
-	// Tracks special order for RR scheduling
-	int RR_order;
+} job_stats_t;
 
-} job_t;
 
+/**
+  Jobs waiting for a core in FIFO order, as a circular list through
+  job_t.run_next.  tail is the last job, and its run_next the first.
+*/
+typedef struct _run_list_t{
+	job_t *tail;
+	int size;
+} run_list_t;
 
-void print_queue(){
-	job_t * curr;
-	for(int i=0; i<priqueue_size(ready_q); ++i){
-		curr = (job_t*)priqueue_at(ready_q, i);
-		if(curr->finished){
-			printf("X%dX ", curr->value[0]);
-		}
-		else{
-			printf("%d(%d) ", curr->value[0], curr->value[3]);
+
+// CFS key, the virtual runtime.  The difference is taken modulo 2^32 so
+// that it stays right across a wrap.
+static inline int cfs_key(const job_t *job){ return job->vruntime; }
+static inline int cfs_cmp(const int *a, const int *b){ return (int)((unsigned int)*a - (unsigned int)*b); }
+
+PRIQUEUE_DEFINE(cfsq, job_t, int, cfs_key, cfs_cmp)
+
+
+/**
+  Key of a job in runnable_q, the key of the policy and then arrival order.
+  Neither changes while the job waits, so it is taken once when the job is
+  queued.
+*/
+typedef struct _runnable_key_t{
+	int rank;
+	int arrival_order;
+} runnable_key_t;
+
+static inline runnable_key_t runnable_key(const job_t *job){
+	runnable_key_t key = {job->rank, job->arrival_order};
+	return key;
+}
+
+static inline int runnable_cmp(const runnable_key_t *a, const runnable_key_t *b){
+	if(a->rank != b->rank){
+		return (a->rank < b->rank) ? -1 : 1;
+	}
+	return (a->arrival_order < b->arrival_order) ? -1 : (a->arrival_order > b->arrival_order);
+}
+
+PRIQUEUE_DEFINE(runnableq, job_t, runnable_key_t, runnable_key, runnable_cmp)
+
+
+/**
+  Entry of a run queue, a job and the order it was queued in
+*/
+typedef struct _run_entry_t{
+	job_t *job;
+	unsigned long seq;
+} run_entry_t;
+
+
+/**
+  Jobs waiting for one core under PER_CORE_QUEUES, as a min-max heap: the
+  levels of the heap alternate between holding the least and the most
+  important job of their subtree, so both the front, for the owner, and the
+  tail, for a thief, are reachable in O(log n).  Jobs are ordered by the
+  run queue comparison of the policy, then in the order they were queued.
+*/
+typedef struct _run_queue_t{
+	run_entry_t *heap;
+	int size;
+	int capacity;
+	unsigned long next_seq;
+} run_queue_t;
+
+
+/**
+  Header placed in front of the jobs of every job slab
+*/
+typedef struct _job_slab_t{
+	struct _job_slab_t *next;
+	job_t jobs[];
+} job_slab_t;
+
+
+/**
+  One call into the scheduler, waiting to be applied.  Callers build these on
+  their own stack and push them onto the scheduler's pending stack.
+*/
+typedef struct _event_t{
+
+	// One of the EVENT_ constants below
+	int kind;
+
+	// Arguments of the call, as far as its kind uses them
+	int time;
+	int core_id;
+	int job_number;
+	int running_time;
+	int priority;
+
+	// Return value of the call, valid once done is set
+	int result;
+	atomic_int done;
+
+	// Next older event on the pending stack
+	struct _event_t *next;
+
+} event_t;
+
+// Kinds of event, in the order events of the same time unit are applied
+enum {EVENT_FINISHED = 0, EVENT_EXPIRED, EVENT_ARRIVAL};
+
+
+/**
+  State of one scheduler instance.  Every function below works on the
+  instance passed in, so independent schedulers can run side by side.
+*/
+struct _scheduler_t{
+
+	// Track busy cores
+	int *active_core;
+	int num_cores;
+
+	// One bit per core, set while the core is idle, 64 cores to a word
+	unsigned long long *idle_cores;
+	int idle_words;
+
+	// Keep track of scheme
+	scheme_t policy;
+
+	// Under PER_CORE_QUEUES, the jobs waiting for each core, ordered by policy.
+	// NULL when every core draws from the same jobs.
+	run_queue_t *run_queues;
+
+	// Jobs that could run but are not on a core, ordered like the run
+	// queues.  NULL under RR, MLFQ, CFS and PER_CORE_QUEUES, and empty
+	// while waiting_q is in use.
+	runnableq_t *runnable_q;
+
+	// Under RR with one ready queue, the jobs waiting for a core instead
+	run_list_t run_list;
+
+	// Under MLFQ, the jobs waiting for a core at each level instead, and
+	// the time of the next boost
+	run_list_t levels[MLFQ_LEVELS];
+	int next_boost;
+
+	// Under CFS, the jobs waiting for a core instead, least virtual runtime
+	// first and in the order they were queued on a tie, and the least
+	// virtual runtime seen so far among the jobs that could run, never
+	// decreasing.  Arriving jobs start from it.
+	cfsq_t cfs_q;
+	int min_vruntime;
+
+	// Jobs that could run but are not on a core, by priority.  NULL unless the
+	// policy is PRI or PPRI and every priority so far fit in PRI_BUCKETS.
+	bucketq_t *waiting_q;
+
+	// Number of jobs seen so far, stamped on each job to keep arrival order
+	int arrivals;
+
+	// Finished jobs are forgotten and only remembered through these totals
+	int completed;
+	long long total_waiting;
+	long long total_turnaround;
+	long long total_response;
+
+	// Slab allocator for jobs, see job_alloc.  Retired jobs are chained
+	// into free_jobs, and every slab is freed together on destroy.
+	job_slab_t *job_slabs;
+	job_t *free_jobs;
+	job_t *job_bump;
+	int job_bump_left;
+	int job_slab_size;
+
+	// Statistics of every job record handed out so far, indexed by
+	// job_t.slot
+	job_stats_t *stats;
+	int num_slots;
+	int stats_size;
+
+	// Open addressing table from job number to job, for every job that has
+	// arrived and not finished.
+	// Linear probing over a power of two number of slots, kept at most half full.
+	job_t **job_index;
+	int job_index_bits;
+	int job_index_size;
+
+	// Jobs on a core under PSJF and PPRI, as a heap with the least important
+	// job on top, so that running[0] is the job to preempt.  NULL under the
+	// other policies.
+	job_t **running;
+	int num_running;
+
+	// Calls not applied yet, newest first.  Pushed without a lock, and
+	// applied in batches by whichever caller holds combiner.
+	_Atomic(event_t *) pending;
+	pthread_mutex_t combiner;
+
+	// Latest time an event has been applied at.  Only touched with
+	// combiner held.
+	int now;
+
+};
+
+
+
+void print_queue(scheduler_t *s){
+	for(int i = 0; i < (1 << s->job_index_bits); ++i){
+		job_t *curr = s->job_index[i];
+		if(NULL != curr){
+			printf("%d(%d) ", curr->number, curr->priority);
 		}
 	}
 	printf("\n");
@@ -80,21 +371,21 @@ void update_running_time(job_t * job, int time){
 	// time, or 0 if this job has not run yet
 	
 	// If this job has already been active...
-	if(0 <= job->value[6]){
+	if(0 <= job->last_active){
 		if(DEBUG){
-			printf("Computing new run time as %d - %d...\n", time, job->value[6]);
+			printf("Computing new run time as %d - %d...\n", time, job->last_active);
 		}
-		new_running_time = time - job->value[6];
+		new_running_time = time - job->last_active;
 	}
 	
 	// Update last active time
-	job->value[6] = time;
+	job->last_active = time;
 	if(DEBUG){
-		printf("Job %d running time incremented from  %d to %d\n", job->value[0], job->value[4], job->value[4]+new_running_time);
-		printf("Job %d last active time updated to %d\n", job->value[0], job->value[6]);
+		printf("Job %d remaining time decremented from %d to %d\n", job->number, job->remaining, job->remaining-new_running_time);
+		printf("Job %d last active time updated to %d\n", job->number, job->last_active);
 	}
 	
-	job->value[4] += new_running_time;
+	job->remaining -= new_running_time;
 }
 
 
@@ -104,44 +395,112 @@ void update_running_time(job_t * job, int time){
  * @param job A pointer to the job to update
  * @param time An integer representing the current time unit
  */
-void update_latency_time(job_t* job, int time){
+void update_latency_time(scheduler_t *s, job_t* job, int time){
+	job_stats_t *stats = &s->stats[job->slot];
+
 	// If we haven't already set it...
-	if(0 > job->value[7]){
-		job->value[7] = time - job->value[1];
+	if(0 > stats->latency){
+		stats->latency = time - stats->arrival;
 		if(DEBUG){
-			printf("Job %d latency updated to %d\n", job->value[0], job->value[7]);
+			printf("Job %d latency updated to %d\n", job->number, stats->latency);
 		}
 	}
 }
 
 
+// Run queue comparison for each scheme_t, filled in with the comparisons
+// below
+static int (*const local_comparisons[CFS + 1])(const void *, const void *);
+
+
 /**
- * @brief Computes and updates time metrics for the job given
- *
- * @param job A pointer to the job to update
- * @param time An integer representing the current time unit
+ * @brief Returns non-zero if job a is less important than job b under the
+ * policy, later arrivals being less important on a tie
  */
-void update_time(int time){
+static int runs_after(scheduler_t *s, job_t *a, job_t *b){
+	return 0 < local_comparisons[s->policy](a, b);
+}
 
-	job_t *curr_job;
 
-	for(int i = 0; i<priqueue_size(ready_q); ++i){
-		curr_job = (job_t*)priqueue_at(ready_q, i);
+/**
+ * @brief Moves the running job at position i towards the top of the heap
+ * while it is less important than its parent
+ */
+static void running_sift_up(scheduler_t *s, int i){
+	job_t *job = s->running[i];
+	while(0 < i && runs_after(s, job, s->running[(i - 1) / 2])){
+		s->running[i] = s->running[(i - 1) / 2];
+		s->running[i]->running_index = i;
+		i = (i - 1) / 2;
+	}
+	s->running[i] = job;
+	job->running_index = i;
+}
 
-		assert(NULL != curr_job);
 
-		// if active or just ended
-		if(0 <= curr_job->core){
-			update_running_time(curr_job, time);
-			update_latency_time(curr_job, time);
-		}
-		else if(time == curr_job->value[5]){
-			update_running_time(curr_job, time);
-			
+/**
+ * @brief Moves the running job at position i away from the top of the heap
+ * while one of its children is less important
+ */
+static void running_sift_down(scheduler_t *s, int i){
+	job_t *job = s->running[i];
+	int child;
+	while((child = 2 * i + 1) < s->num_running){
+		if(child + 1 < s->num_running && runs_after(s, s->running[child + 1], s->running[child])){
+			child++;
 		}
-		if(DEBUG){
-			printf("Time updated, job %d\n", curr_job->value[0]);
+		if(!runs_after(s, s->running[child], job)){
+			break;
 		}
+		s->running[i] = s->running[child];
+		s->running[i]->running_index = i;
+		i = child;
+	}
+	s->running[i] = job;
+	job->running_index = i;
+}
+
+
+/**
+ * @brief Adds a job that was just given a core to the running heap
+ */
+void running_add(scheduler_t *s, job_t *job){
+	s->running[s->num_running] = job;
+	running_sift_up(s, s->num_running++);
+}
+
+
+/**
+ * @brief Takes a job that is leaving its core out of the running heap
+ */
+void running_remove(scheduler_t *s, job_t *job){
+	int i = job->running_index;
+	job_t *last = s->running[--s->num_running];
+	if(job == last){
+		return;
+	}
+	s->running[i] = last;
+	last->running_index = i;
+	running_sift_up(s, i);
+	running_sift_down(s, last->running_index);
+}
+
+
+/**
+ * @brief Brings the remaining time of every running job up to the given
+ * time, so that comparisons against them see how much work they have left
+ * now rather than when they were last accounted for
+ *
+ * Running jobs are otherwise only accounted for when they leave their core,
+ * so this is the one place their remaining time is computed on demand.
+ *
+ * All running jobs advance by the same amount, so the heap stays in order.
+ *
+ * @param time An integer representing the current time
+ */
+void refresh_running(scheduler_t *s, int time){
+	for(int i = 0; i < s->num_running; ++i){
+		update_running_time(s->running[i], time);
 	}
 }
 
@@ -149,33 +508,33 @@ void update_time(int time){
 /**
  * @brief fetches the currently running job to be preempted by the job passed in, or NULL if none exist
  *
+ * The least important running job is on top of the running heap.  If the
+ * job passed in does not trump that one, it does not trump any of them.
+ *
  * @param job A job_t to compare against existing jobs, the preempting job
  *
  * @return A job to be preempted, or NULL if none exists
  */
-job_t* get_preempt_job(job_t *current_job){
-
-	// To accurately judge which needs to be preempted, we need to look
-	// from the back of the list forward
-	job_t *running_job;
-
-	for(int i = priqueue_size(ready_q)-1; i>=0; --i){
-		
-		running_job = (job_t*)priqueue_at(ready_q, i);
+job_t* get_preempt_job(scheduler_t *s, job_t *current_job){
 
-		// If the job is running
-		if(0 <= running_job->core){
-			//and the job passed in trumps it
-			if(0 >= ready_q->compare(current_job, running_job)){
-				return running_job;
-			}
-		}
+	if(0 < s->num_running && runs_after(s, s->running[0], current_job)){
+		return s->running[0];
 	}
-
 	return NULL;
 }
 
 
+/**
+ * @brief Marks a core as idle, clearing its entry in active_core
+ *
+ * @param core The index of the core in active_core
+ */
+void set_core_idle(scheduler_t *s, int core){
+	s->active_core[core] = -1;
+	s->idle_cores[core / 64] |= 1ULL << (core % 64);
+}
+
+
 /**
  * @brief Returns the integer corresponding to the lowest free core
  * 
@@ -183,15 +542,175 @@ job_t* get_preempt_job(job_t *current_job){
  * or -1 if no cores are free.
  *
  */
-int get_idle_core(){
+int get_idle_core(scheduler_t *s){
+
+	for(int i = 0; i < s->idle_words; ++i){
+		if(0 != s->idle_cores[i]){
+			return 64 * i + __builtin_ctzll(s->idle_cores[i]);
+		}
+	}
+	return -1;
+}
+
+
+/**
+ * @brief Returns the number of idle cores
+ */
+int count_idle_cores(scheduler_t *s){
+
+	int idle = 0;
+	for(int i = 0; i < s->idle_words; ++i){
+		idle += __builtin_popcountll(s->idle_cores[i]);
+	}
+	return idle;
+}
+
+
+/**
+ * @brief Returns the slot in job_index where the search for a job number
+ * starts
+ */
+static unsigned int job_home(scheduler_t *s, int job_number){
+	// Fibonacci hashing, the top bits of the product are well mixed
+	return ((unsigned int)job_number * 2654435769u) >> (32 - s->job_index_bits);
+}
+
+
+/**
+ * @brief Allocates a new slab of count jobs and makes it the bump region
+ *
+ * The slab header is padded to the alignment of job_t, so aligning the slab
+ * aligns every job in it.
+ */
+static void add_job_slab(scheduler_t *s, int count){
+	job_slab_t *slab = (job_slab_t *)aligned_alloc(_Alignof(job_t), sizeof(job_slab_t) + count * sizeof(job_t));
+	if(NULL == slab){
+		fprintf(stderr, "Out of memory.\n");
+		exit(2);
+	}
+	slab->next = s->job_slabs;
+	s->job_slabs = slab;
+	s->job_bump = slab->jobs;
+	s->job_bump_left = count;
+
+	// Grow geometrically so a long trace needs few slabs
+	s->job_slab_size = (2 * count < JOB_MAX_SLAB) ? 2 * count : JOB_MAX_SLAB;
+}
+
+
+/**
+ * @brief Hands out a job record and its slot in stats.  Retired jobs are
+ * reused first, then the unused tail of the newest slab, and only then is a
+ * new slab allocated.
+ */
+job_t *job_alloc(scheduler_t *s){
+	job_t *job;
+	if(NULL != s->free_jobs){
+		job = s->free_jobs;
+		s->free_jobs = job->next_free;
+		return job;
+	}
+	if(0 == s->job_bump_left){
+		add_job_slab(s, s->job_slab_size);
+	}
+	job = s->job_bump++;
+	s->job_bump_left--;
+
+	// A fresh record also takes a fresh slot
+	if(s->num_slots == s->stats_size){
+		s->stats_size = (0 < s->stats_size) ? 2 * s->stats_size : JOB_MIN_SLAB;
+		s->stats = (job_stats_t *)realloc(s->stats, s->stats_size * sizeof(job_stats_t));
+		if(NULL == s->stats){
+			fprintf(stderr, "Out of memory.\n");
+			exit(2);
+		}
+	}
+	job->slot = s->num_slots++;
+	return job;
+}
+
+
+/**
+ * @brief Returns a retired job to the free list, keeping its slot
+ */
+void job_release(scheduler_t *s, job_t *job){
+	job->next_free = s->free_jobs;
+	s->free_jobs = job;
+}
+
+
+/**
+ * @brief Allocates an empty job_index with 2^bits slots
+ */
+void job_index_init(scheduler_t *s, int bits){
+	s->job_index_bits = bits;
+	s->job_index_size = 0;
+	s->job_index = (job_t **)calloc(1 << bits, sizeof(job_t *));
+	if(NULL == s->job_index){
+		fprintf(stderr, "Out of memory.\n");
+		exit(2);
+	}
+}
+
+
+/**
+ * @brief Adds a job to job_index, doubling the table when it would become
+ * more than half full
+ *
+ * @param job A pointer to the job to add, whose job number is not indexed yet
+ */
+void index_job(scheduler_t *s, job_t *job){
+
+	if(2 * (s->job_index_size + 1) > (1 << s->job_index_bits)){
+		job_t **old = s->job_index;
+		int old_slots = 1 << s->job_index_bits;
+		job_index_init(s, s->job_index_bits + 1);
+		for(int i = 0; i < old_slots; ++i){
+			if(NULL != old[i]){
+				index_job(s, old[i]);
+			}
+		}
+		free(old);
+	}
+
+	unsigned int mask = (1u << s->job_index_bits) - 1;
+	unsigned int i = job_home(s, job->number);
+	while(NULL != s->job_index[i]){
+		i = (i + 1) & mask;
+	}
+	s->job_index[i] = job;
+	s->job_index_size++;
+}
+
+
+/**
+ * @brief Removes a job from job_index
+ *
+ * Later entries of the same probe run are shifted back into the hole, so
+ * lookups can keep stopping at the first empty slot.
+ *
+ * @param job A pointer to the job to remove
+ */
+void unindex_job(scheduler_t *s, job_t *job){
+
+	unsigned int mask = (1u << s->job_index_bits) - 1;
+	unsigned int hole = job_home(s, job->number);
+	while(job != s->job_index[hole]){
+		hole = (hole + 1) & mask;
+	}
 
-	int lowest = 9000;
-	for(int i = 0; i<NUM_CORES; ++i){
-		if(0 > active_core[i] && i < lowest){
-			lowest = i;	
-		}	
+	unsigned int i = hole;
+	while(NULL != s->job_index[i = (i + 1) & mask]){
+		// An entry may fill the hole unless its home lies cyclically in
+		// (hole, i], in which case it has not been passed yet
+		unsigned int home = job_home(s, s->job_index[i]->number);
+		if(((i - home) & mask) >= ((i - hole) & mask)){
+			s->job_index[hole] = s->job_index[i];
+			hole = i;
+		}
 	}
-	return lowest;
+	s->job_index[hole] = NULL;
+	s->job_index_size--;
 }
 
 
@@ -204,62 +723,65 @@ int get_idle_core(){
  * @return a pointer the job with the job number passed in, or NULL
  * 	  if no such job exists.
  */
-job_t * get_job(int job_number){
+job_t * get_job(scheduler_t *s, int job_number){
 	
 	if(DEBUG){
 		printf("In get job, looking for %d...\n", job_number);
 	}
-	
-	job_t* result = NULL;
-	job_t *current_job;
-	for(int i = 0; i<priqueue_size(ready_q); ++i){
-		current_job = (job_t*)priqueue_at(ready_q, i);
-		if(job_number == current_job->value[0]){
-			result = current_job;
-			if(DEBUG){
-				printf("Found job %d!\n", current_job->value[0]);
-			}
-			break;
-		}
-		else{
+
+	unsigned int mask = (1u << s->job_index_bits) - 1;
+	unsigned int i = job_home(s, job_number);
+	while(NULL != s->job_index[i]){
+		if(job_number == s->job_index[i]->number){
 			if(DEBUG){
-				printf("Job %d does not match %d\n", current_job->value[0], job_number);
+				printf("Found job %d!\n", job_number);
 			}
+			return s->job_index[i];
 		}
+		i = (i + 1) & mask;
 	}
-	return result;
+	return NULL;
 }
 
 
 /**
  * @brief Associates a job with a core and vice versa
  *
- * @param core An integer representing the index into the active_core global
+ * @param core An integer representing the index into the active_core
  * 	       array of cores
  * @param job A pointer to a job to be updated to the given core
+ * @param time An integer representing the current time unit
  *
- *  Dies if anything is amiss
+ *  Starts the job's running time accounting, and its latency if this is the
+ *  first time it runs.  Dies if anything is amiss
  */
 
-void update_core(int core, job_t * job){
+void update_core(scheduler_t *s, int core, job_t * job, int time){
 
 	if(DEBUG){
-		printf("Updating core %d with job %d...\n", core, job->value[0]);
+		printf("Updating core %d with job %d...\n", core, job->number);
 	}
-	if(core > NUM_CORES){
+	if(core > s->num_cores){
 		printf("[ Error ]\t\tTried to update nonexistent core...\n");
 		assert(0);	
 	}
 	
-	// Update job
+	// Update job, it runs from now on
 	job->core = core;
+	job->last_active = time;
+	update_latency_time(s, job, time);
 
 	if(DEBUG){
-		printf("Job %d core set to %d\n", job->value[0], core);
+		printf("Job %d core set to %d\n", job->number, core);
 	}
 
 	// Update cores and return success
-	active_core[core] = job->value[0];
+	s->active_core[core] = job->number;
+	s->idle_cores[core / 64] &= ~(1ULL << (core % 64));
+
+	if(NULL != s->running){
+		running_add(s, job);
+	}
 
 	return;
 }
@@ -281,12 +803,16 @@ void update_core(int core, job_t * job){
  *
  * 	 Thus all functions need to return accordingly, positive return
  * 	 if the first parameter takes precedence, negative otherwise
+ *
+ * 	 Jobs that tie return 0.  The queue remembers the order jobs were
+ * 	 offered in and puts the earlier one first, which is arrival order,
+ * 	 so the comparisons do not depend on arrival times being unique.
  */
 
 // Round robin comparison
 int comparison_RR(const void *j1, const void *j2){
-	// Always return -1 so that this queue behaves like a FIFO
-	return -1;
+	// Every job ties, so the queue keeps them in FIFO order
+	return 0;
 }
 
 
@@ -305,16 +831,8 @@ int comparison_FCFS(const void *j1, const void *j2){
 		return -1;
 	}
 	else{
-		// Otherwise, evaluate them based on arrival
-		// Since we are guaranteed unique arrival times, simply subtract them.
-		// If the latter came sooner than the former, the result will be
-		// positive.
-		if(DEBUG){
-			printf("Job %d arrived at time %d\n", this->value[0], this->value[1]);
-			printf("job %d arrived at time %d\n", that->value[0], that->value[1]);
-			printf("Job %d came %d seconds before job %d...\n", this->value[0], that->value[1]-this->value[1], that->value[0]);
-		}
-		return (this->value[1] - that->value[1]);
+		// Otherwise they tie, and the queue keeps them in arrival order
+		return 0;
 	}
 }
 
@@ -339,18 +857,12 @@ int comparison_SJF(const void *j1, const void *j2){
 	else{
 		// Compute running time remaining, defined as the burst time minus the
 		// running time.
-		t1 = this->value[2] - this->value[4];
-		t2 = that->value[2] - that->value[4];
-
-		// If the remaining time is equal, compare the arrival times per the
-		// rubric 
-		if(t2 == t1){
-			// This result will be positive if the latter job arrived first
-			return (this->value[1] - that->value[1]);
-		}
+		t1 = this->remaining;
+		t2 = that->remaining;
 
 		// This result will be positive if this job has a longer running
-		// time remaining.
+		// time remaining.  If the remaining time is equal, the queue
+		// falls back on arrival order per the rubric.
 		return (t1-t2);
 	}
 }
@@ -373,26 +885,20 @@ int comparison_PRI(const void *j1, const void *j2){
 	}
 	else{
 		// Otherwise, evaluate them based on priority, then arrival
-		if(this->value[3] == that->value[3]){
+		if(this->priority == that->priority){
 			
-			// Since we are guaranteed unique arrival times, simply subtract them.
-			// If the latter came sooner than the former, the result will be
-			// positive.
-			if(DEBUG){
-				printf("Job %d arrived at time %d\n", this->value[0], this->value[1]);
-				printf("job %d arrived at time %d\n", that->value[0], that->value[1]);
-				printf("Job %d came %d seconds before job %d...\n", this->value[0], that->value[1]-this->value[1], that->value[0]);
-			}
-			return (this->value[1] - that->value[1]);
+			// Equal priorities tie, and the queue keeps them in
+			// arrival order
+			return 0;
 		}
 		else{
 			if(DEBUG){
-				printf("Job %d has priority %d\n", this->value[0], this->value[3]);
-				printf("Job %d has priority %d\n", that->value[0], that->value[3]);
-				printf("Returning %d...\n", this->value[3]-that->value[3]);
+				printf("Job %d has priority %d\n", this->number, this->priority);
+				printf("Job %d has priority %d\n", that->number, that->priority);
+				printf("Returning %d...\n", this->priority-that->priority);
 			}
 			// Positive if the former is higher priority
-			return (this->value[3] - that->value[3]);	
+			return (this->priority - that->priority);	
 		}
 	}
 }
@@ -407,28 +913,21 @@ int comparison_PPRI(const void *j1, const void *j2){
 	that = (job_t*)j2;
 	
 	// Evaluate them based on priority, then arrival
-	if(this->value[3] == that->value[3]){
+	if(this->priority == that->priority){
 		
-		// Since we are guaranteed unique arrival times, simply subtract them.
-		// If the latter came sooner than the former, the result will be
-		// positive.
-		if(DEBUG){
-			printf("Job %d arrived at time %d\n", this->value[0], this->value[1]);
-			printf("job %d arrived at time %d\n", that->value[0], that->value[1]);
-			printf("Job %d came %d seconds before job %d...\n", this->value[0], that->value[1]-this->value[1], that->value[0]);
-		}
-		return (this->value[1] - that->value[1]);
+		// Equal priorities tie, and the queue keeps them in arrival order
+		return 0;
 	}
 	else{
 		if(DEBUG){
-			printf("Job %d has priority %d\n", this->value[0], this->value[3]);
-			printf("Job %d has priority %d\n", that->value[0], that->value[3]);
-			printf("Returning %d...\n", this->value[3]-that->value[3]);
+			printf("Job %d has priority %d\n", this->number, this->priority);
+			printf("Job %d has priority %d\n", that->number, that->priority);
+			printf("Returning %d...\n", this->priority-that->priority);
 		}
 		// Positive if the former is higher priority
 		// Note that this is exactly backwards wrt what we discussed
 		// in class and most Linux systems.
-		return (this->value[3] - that->value[3]);	
+		return (this->priority - that->priority);	
 	}
 }
 
@@ -445,225 +944,637 @@ int comparison_PSJF(const void *j1, const void *j2){
 
 	// Compute running time remaining, defined as the burst time minus the
 	// running time.
-	t1 = this->value[2] - this->value[4];
-	t2 = that->value[2] - that->value[4];
+	t1 = this->remaining;
+	t2 = that->remaining;
 
-	// If the remaining time is equal, compare the arrival times per the
-	// rubric 
-	if(t2 == t1){
-		if(DEBUG){
-			printf("Both jobs have %d time remaining\n", t1);
-			printf("Job %d arrived at time %d\n", this->value[0], this->value[1]);
-			printf("job %d arrived at time %d\n", that->value[0], that->value[1]);
-			printf("Job %d came %d seconds before job %d...\n", this->value[0], that->value[1]-this->value[1], that->value[0]);
-		}
-				
-		// This result will be positive if the latter job arrived first
-		return (this->value[1] - that->value[1]);
-	}
-	else{
-		if(DEBUG){
-			printf("Job %d has remaining time %d\n", this->value[0], t1);
-			printf("Job %d has remaining time %d\n", that->value[0], t2);
-			printf("Returning %d...\n", t1-t2);
-		}
-			
+	if(DEBUG){
+		printf("Job %d has remaining time %d\n", this->number, t1);
+		printf("Job %d has remaining time %d\n", that->number, t2);
+		printf("Returning %d...\n", t1-t2);
 	}
+
 	// This result will be positive if this job has a longer running
-	// time remaining.
+	// time remaining.  If the remaining time is equal, the queue falls
+	// back on arrival order per the rubric.
 	return (t1-t2);
 }
 
 
-/**
- * @brief Determines the next job to be scheduled for non-preemptive schemes
- * 
- * @param new_job An artifact from earlier versions that I was too lazy to
- * 		  remove
- *
- * @param time An integer representing the current time		  
- *
- * NOTE: This method schedules and updates everything blindly, plan
- * 	 accordingly.  Relies on the ready queue being sorted by precedence.
+/*
+ * Run queue comparisons under PER_CORE_QUEUES.  They follow the policy, then
+ * arrival order, so that a job put back on a run queue after being preempted
+ * keeps its place among jobs that tie with it, as it would by arrival.  RR run
+ * queues use comparison_RR, since rotation relies on insertion order.
  */
-void next_job_no_preempt(job_t* new_job, int time){
+static int by_arrival(int ret, const void *j1, const void *j2){
+	if(0 != ret){
+		return ret;
+	}
+	return ((job_t *)j1)->arrival_order - ((job_t *)j2)->arrival_order;
+}
 
-	job_t* next_job = NULL;
-	int length = priqueue_size(ready_q);
-	int found;
-	if(0 < length){
-	
-		// If not empty, search through the queue
-		// Everything should be sorted by arrival automatically by
-		// priqueue_offer
-		int idle = get_idle_core();
-
-		while(9000 != idle){
-			found = 0;
-			for(int i = 0; i<length; ++i){
-				next_job = (job_t*)priqueue_at(ready_q, i);
-			
-				// If the current job is not finished..
-				if(next_job->finished != 1){
-		
-					if(DEBUG){
-						printf("Job %d is not finished(%d)...\n", next_job->value[0], next_job->finished);
-					}
-				
-					// and it is not already running...
-					if(0 > next_job->core){
-				
-						if(DEBUG){
-							printf("and not running, it will be the next job...\n");
-						}
-						found = 1;
-						break;
-					}
-					else{
-						if(DEBUG){
-							printf("Job %d is running, moving on...\n", next_job->value[0]);
-						}
-					}
-				}
-				else{
-					if(DEBUG){
-						printf("Job %d is finished, moving on...\n", next_job->value[0]);
-					}
-				}
-			}
+int comparison_local_FCFS(const void *j1, const void *j2){
+	return by_arrival(comparison_FCFS(j1, j2), j1, j2);
+}
 
-			if(found){
-				if(DEBUG){
-					printf("Updating core %d, currently running: %d\n", idle, active_core[idle]);
-				}
-				update_core(idle, next_job);
-				if(DEBUG){
-					printf("Core %d is now running job %d\n", idle, active_core[idle]);
-				}
-				
+int comparison_local_SJF(const void *j1, const void *j2){
+	return by_arrival(comparison_SJF(j1, j2), j1, j2);
+}
 
-				// Update last active time to next time cycle
-				next_job->value[6] = time;
+int comparison_local_PSJF(const void *j1, const void *j2){
+	return by_arrival(comparison_PSJF(j1, j2), j1, j2);
+}
 
+int comparison_local_PRI(const void *j1, const void *j2){
+	return by_arrival(comparison_PRI(j1, j2), j1, j2);
+}
 
-				idle = get_idle_core();
-			}
-			else{
-				if(DEBUG){
-					printf("No valid jobs found to schedule\n");
-				}
-				break;
-			}
-		}// End while
-	}// End if(0 < length)
+int comparison_local_PPRI(const void *j1, const void *j2){
+	return by_arrival(comparison_PPRI(j1, j2), j1, j2);
 }
 
+// Run queue comparison for each scheme_t
+static int (*const local_comparisons[])(const void *, const void *) = {
+	[FCFS]	= comparison_local_FCFS,
+	[SJF]	= comparison_local_SJF,
+	[PSJF]	= comparison_local_PSJF,
+	[PRI]	= comparison_local_PRI,
+	[PPRI]	= comparison_local_PPRI,
+	[RR]	= comparison_RR,
+	[MLFQ]	= comparison_RR,
+	[CFS]	= comparison_RR,
+};
+
 
 /**
- * @brief Determines the next job to be scheduled for preemptive schemes
- * 
- * @param new_job An artifact from earlier versions that I was too lazy to
- * 		  remove
- *
- * @param time An integer representing the current time		  
- *
- * NOTE: This method schedules and updates everything blindly, plan
- * 	 accordingly.  Relies on the ready queue being sorted by precedence.
+ * @brief Appends a job to the tail of a run list in O(1)
  */
-void next_job_preempt(job_t *new_job, int time){
-	
-	job_t *next_job;
-	
-	next_job = NULL;
-	int length = priqueue_size(ready_q);
-	if(length > 0){
-	
-		for(int i = 0; i<length; ++i){
-			next_job = (job_t *)priqueue_at(ready_q, i);
+void run_list_push(run_list_t *list, job_t *job){
+	if(NULL == list->tail){
+		job->run_next = job;
+	}
+	else{
+		job->run_next = list->tail->run_next;
+		list->tail->run_next = job;
+	}
+	list->tail = job;
+	list->size++;
+}
 
-			// If the current job is not finished..
-			if(next_job->finished != 1){
-		
-				if(DEBUG){
-					printf("Job %d is not finished...\n", next_job->value[0]);
-				}
-			
-				// and it is not already running...
-
-				if(0 > next_job->core){
-					if(DEBUG){
-						printf("and not running, checking for free cores...\n");
-					}
-
-					// If an idle core exists, assign this
-					// job to that core
-					int idle = get_idle_core();
-
-					if(9000 != idle){
-						if(DEBUG){
-							printf("An idle core exists to be scheduled...\n");	
-							printf("Updating core %d, currently running: %d\n", idle, active_core[idle]);
-						}
-						update_core(idle, next_job);
-						if(DEBUG){
-							printf("Core %d is now running job %d\n", idle, active_core[idle]);
-						}
-					}
-					else{
-						// Otherwise, check if any of the jobs
-						// existing jobs should be preempted
+
+/**
+ * @brief Takes the job at the head of a run list in O(1)
+ *
+ * @return The job, or NULL if none is waiting
+ */
+job_t *run_list_pop(run_list_t *list){
+	if(NULL == list->tail){
+		return NULL;
+	}
+	job_t *head = list->tail->run_next;
+	if(head == list->tail){
+		list->tail = NULL;
+	}
+	else{
+		list->tail->run_next = head->run_next;
+	}
+	head->run_next = NULL;
+	list->size--;
+	return head;
+}
+
+
+/**
+ * @brief Moves every job of src to the tail of dst in O(1), keeping their
+ * order, and leaves src empty
+ */
+void run_list_splice(run_list_t *dst, run_list_t *src){
+	if(NULL == src->tail){
+		return;
+	}
+	if(NULL != dst->tail){
+		job_t *head = dst->tail->run_next;
+		dst->tail->run_next = src->tail->run_next;
+		src->tail->run_next = head;
+	}
+	dst->tail = src->tail;
+	dst->size += src->size;
+	src->tail = NULL;
+	src->size = 0;
+}
+
+
+/**
+ * @brief Puts a job that is off its core where the dispatcher looks for
+ * waiting jobs: waiting_q, runnable_q, cfs_q, its MLFQ level or the RR run
+ * list
+ */
+void make_runnable(scheduler_t *s, job_t *job){
+	if(NULL != s->waiting_q){
+		job->waiting = bucketq_offer(s->waiting_q, job, job->priority, job->arrival_order);
+	}
+	else if(NULL != s->runnable_q){
+		switch(s->policy){
+			case SJF:
+			case PSJF:
+				job->rank = job->remaining;
+				break;
+			case PRI:
+			case PPRI:
+				job->rank = job->priority;
+				break;
+			default:
+				job->rank = 0;
+		}
+		runnableq_offer(s->runnable_q, job);
+	}
+	else if(CFS == s->policy){
+		cfsq_offer(&s->cfs_q, job);
+	}
+	else if(MLFQ == s->policy){
+		run_list_push(&s->levels[job->level], job);
+	}
+	else{
+		run_list_push(&s->run_list, job);
+	}
+}
+
+
+/**
+ * @brief Returns the number of jobs waiting for a core with one ready queue
+ */
+int waiting_jobs(scheduler_t *s){
+	if(NULL != s->waiting_q){
+		return bucketq_size(s->waiting_q);
+	}
+	if(NULL != s->runnable_q){
+		return runnableq_size(s->runnable_q);
+	}
+	if(CFS == s->policy){
+		return cfsq_size(&s->cfs_q);
+	}
+	if(MLFQ == s->policy){
+		int waiting = 0;
+		for(int i = 0; i < MLFQ_LEVELS; ++i){
+			waiting += s->levels[i].size;
+		}
+		return waiting;
+	}
+	return s->run_list.size;
+}
+
+
+/**
+ * @brief Determines the next job to be scheduled for non-preemptive schemes
+ * 
+ * @param new_job An artifact from earlier versions that I was too lazy to
+ * 		  remove
+ *
+ * @param time An integer representing the current time		  
+ *
+ * Every job in runnable_q is off its core, best first, so each idle core
+ * takes the front one.  Filling k cores costs k polls.
+ */
+void next_job_no_preempt(scheduler_t *s, job_t* new_job, int time){
+
+	job_t* next_job;
+	int idle = get_idle_core(s);
+
+	while(0 <= idle && NULL != (next_job = runnableq_poll(s->runnable_q))){
+		if(DEBUG){
+			printf("Updating core %d, currently running: %d\n", idle, s->active_core[idle]);
+		}
+		update_core(s, idle, next_job, time);
+		if(DEBUG){
+			printf("Core %d is now running job %d\n", idle, s->active_core[idle]);
+		}
+
+		idle = get_idle_core(s);
+	}
+}
+
+
+/**
+ * @brief Takes a running job off its core so another job can use it
+ *
+ * @param old_job The running job to preempt
+ * @param time An integer representing the current time
+ *
+ * @return The core the job was running on
+ */
+int preempt_job(scheduler_t *s, job_t *old_job, int time){
+
+	int core = old_job->core;
+
+	if(NULL != s->running){
+		running_remove(s, old_job);
+	}
+
+	// update its time
+	update_running_time(old_job, time);
+
+	// Reset its core
+	old_job->core = -1;
+
+	// Reset its active time to ensure proper running time accounting
+	old_job->last_active = -1;
+
+	// If the job has yet to run, reset its latency
+	if(s->stats[old_job->slot].burst == old_job->remaining){
+		s->stats[old_job->slot].latency = -1;
+	}
+
+	return core;
+}
+
+
+/**
+ * @brief Returns non-zero if run queue entry a comes before entry b
+ */
+static int run_entry_before(scheduler_t *s, run_entry_t *a, run_entry_t *b){
+	int ret = local_comparisons[s->policy](a->job, b->job);
+	if(0 != ret){
+		return 0 > ret;
+	}
+	return a->seq < b->seq;
+}
+
+
+/**
+ * @brief Returns non-zero if position i of a run queue is on a min level,
+ * one whose entries come before everything below them
+ */
+static int run_queue_min_level(int i){
+	return 0 == ((31 - __builtin_clz(i + 1)) & 1);
+}
+
+
+static void run_queue_swap(run_queue_t *rq, int i, int j){
+	run_entry_t temp = rq->heap[i];
+	rq->heap[i] = rq->heap[j];
+	rq->heap[j] = temp;
+}
+
+
+/**
+ * @brief Moves the entry at position i up its grandparents while it belongs
+ * in front of them, on min levels if min is set, on max levels otherwise
+ */
+static void run_queue_bubble_up(scheduler_t *s, run_queue_t *rq, int i, int min){
+	while(2 < i){
+		int grandparent = ((i - 1) / 2 - 1) / 2;
+		run_entry_t *a = &rq->heap[i];
+		run_entry_t *b = &rq->heap[grandparent];
+		if(min ? !run_entry_before(s, a, b) : !run_entry_before(s, b, a)){
+			break;
+		}
+		run_queue_swap(rq, i, grandparent);
+		i = grandparent;
+	}
+}
+
+
+/**
+ * @brief Moves the entry at position i down while an entry below it belongs
+ * in front of it, on min levels if min is set, on max levels otherwise
+ */
+static void run_queue_trickle_down(scheduler_t *s, run_queue_t *rq, int i, int min){
+	while(2 * i + 1 < rq->size){
+
+		// The best of the children and grandchildren
+		int m = 2 * i + 1;
+		int candidates[] = {2 * i + 2, 4 * i + 3, 4 * i + 4, 4 * i + 5, 4 * i + 6};
+		for(int c = 0; c < 5 && candidates[c] < rq->size; ++c){
+			run_entry_t *a = &rq->heap[candidates[c]];
+			if(min ? run_entry_before(s, a, &rq->heap[m]) : run_entry_before(s, &rq->heap[m], a)){
+				m = candidates[c];
+			}
+		}
+
+		run_entry_t *a = &rq->heap[m];
+		if(min ? !run_entry_before(s, a, &rq->heap[i]) : !run_entry_before(s, &rq->heap[i], a)){
+			break;
+		}
+		run_queue_swap(rq, i, m);
+		if(m <= 2 * i + 2){
+			break;
+		}
+
+		// A grandchild moved down past its parent, which is on the
+		// opposite kind of level
+		int parent = (m - 1) / 2;
+		a = &rq->heap[m];
+		if(min ? run_entry_before(s, &rq->heap[parent], a) : run_entry_before(s, a, &rq->heap[parent])){
+			run_queue_swap(rq, m, parent);
+		}
+		i = m;
+	}
+}
+
+
+/**
+ * @brief Takes the entry at position i out of a run queue
+ *
+ * @return The job it held
+ */
+static job_t *run_queue_take(scheduler_t *s, run_queue_t *rq, int i){
+	job_t *job = rq->heap[i].job;
+	rq->heap[i] = rq->heap[--rq->size];
+	if(i < rq->size){
+		run_queue_trickle_down(s, rq, i, run_queue_min_level(i));
+	}
+	return job;
+}
+
+
+/**
+ * @brief Takes the front job of a run queue, or NULL if it is empty
+ */
+job_t *run_queue_poll(scheduler_t *s, run_queue_t *rq){
+	if(0 == rq->size){
+		return NULL;
+	}
+	return run_queue_take(s, rq, 0);
+}
+
+
+/**
+ * @brief Takes the tail job of a non-empty run queue, the one its core would
+ * get to last
+ */
+job_t *run_queue_poll_tail(scheduler_t *s, run_queue_t *rq){
+	int i = 0;
+	if(2 == rq->size || (2 < rq->size && run_entry_before(s, &rq->heap[2], &rq->heap[1]))){
+		i = 1;
+	}
+	else if(2 < rq->size){
+		i = 2;
+	}
+	return run_queue_take(s, rq, i);
+}
+
+
+/**
+ * @brief Puts a job that is waiting for a core on the run queue of the given
+ * core
+ */
+void enqueue_local(scheduler_t *s, int core, job_t *job){
+	run_queue_t *rq = &s->run_queues[core];
+	if(rq->size == rq->capacity){
+		rq->capacity = (0 == rq->capacity) ? 16 : 2 * rq->capacity;
+		rq->heap = (run_entry_t *)realloc(rq->heap, rq->capacity * sizeof(run_entry_t));
+		if(NULL == rq->heap){
+			fprintf(stderr, "Out of memory.\n");
+			exit(2);
+		}
+	}
+
+	job->home = core;
+	int i = rq->size++;
+	rq->heap[i].job = job;
+	rq->heap[i].seq = rq->next_seq++;
+	if(0 == i){
+		return;
+	}
+
+	// Against its parent first, which is on the other kind of level
+	int parent = (i - 1) / 2;
+	int min = run_queue_min_level(i);
+	if(min ? run_entry_before(s, &rq->heap[parent], &rq->heap[i]) : run_entry_before(s, &rq->heap[i], &rq->heap[parent])){
+		run_queue_swap(rq, i, parent);
+		run_queue_bubble_up(s, rq, parent, !min);
+	}
+	else{
+		run_queue_bubble_up(s, rq, i, min);
+	}
+}
+
+
+/**
+ * @brief Returns the core whose run queue has the fewest waiting jobs,
+ * preferring the lowest id on a tie
+ */
+int least_loaded_core(scheduler_t *s){
+
+	int best = 0;
+	for(int i = 1; i < s->num_cores; ++i){
+		if(s->run_queues[i].size < s->run_queues[best].size){
+			best = i;
+		}
+	}
+	return best;
+}
+
+
+/**
+ * @brief Returns the core other than the one given whose run queue has the
+ * most waiting jobs, or -1 if all of them are empty
+ */
+int busiest_core(scheduler_t *s, int core){
+
+	int best = -1;
+	int most = 0;
+	for(int i = 0; i < s->num_cores; ++i){
+		if(i != core && s->run_queues[i].size > most){
+			best = i;
+			most = s->run_queues[i].size;
+		}
+	}
+	return best;
+}
+
+
+/**
+ * @brief Takes the next job for a core off its own run queue, or steals one
+ * when that is empty
+ *
+ * The owner works from the front of its run queue.  A thief takes from the
+ * tail of the busiest other run queue, the job its owner would get to last,
+ * like the owner and thief ends of a Chase-Lev deque.  Both ends cost
+ * O(log n) in the depth of that run queue.
+ *
+ * @param core The core looking for work
+ *
+ * @return The job, no longer on any run queue, or NULL if every run queue is
+ * empty
+ */
+job_t *take_local(scheduler_t *s, int core){
+
+	job_t *next_job = run_queue_poll(s, &s->run_queues[core]);
+
+	if(NULL == next_job){
+		int victim = busiest_core(s, core);
+		if(0 > victim){
+			return NULL;
+		}
+
+		next_job = run_queue_poll_tail(s, &s->run_queues[victim]);
+
+		if(DEBUG){
+			printf("Core %d stole job %d from core %d\n", core, next_job->number, victim);
+		}
+	}
+	return next_job;
+}
+
+
+/**
+ * @brief Fills an idle core from the run queues under PER_CORE_QUEUES
+ *
+ * @param core The idle core
+ * @param time An integer representing the current time
+ */
+void next_job_local(scheduler_t *s, int core, int time){
+
+	job_t *next_job = take_local(s, core);
+	if(NULL != next_job){
+		update_core(s, core, next_job, time);
+	}
+}
+
+
+/**
+ * @brief Places a newly arrived job under PER_CORE_QUEUES
+ *
+ * The job takes the lowest idle core if there is one.  Otherwise it joins the
+ * least loaded run queue, and under PSJF and PPRI it only competes with the
+ * job running on that core.  A job it preempts goes back on the same run
+ * queue, its home.
+ *
+ * @param job The job that just arrived
+ * @param time An integer representing the current time
+ */
+void place_job_local(scheduler_t *s, job_t *job, int time){
+
+	int core = get_idle_core(s);
+	if(0 <= core){
+		update_core(s, core, job, time);
+		return;
+	}
+
+	core = least_loaded_core(s);
+	if(PSJF == s->policy || PPRI == s->policy){
+		job_t *old_job = get_job(s, s->active_core[core]);
+
+		// Compare against the work the running job has left now
+		update_running_time(old_job, time);
+
+		if(runs_after(s, old_job, job)){
+			if(DEBUG){
+				printf("Job %d will preempt job %d on core %d...\n", job->number, old_job->number, core);
+			}
+			preempt_job(s, old_job, time);
+			enqueue_local(s, core, old_job);
+			update_core(s, core, job, time);
+			return;
+		}
+	}
+	enqueue_local(s, core, job);
+}
+
+
+/**
+ * @brief Determines the next job to be scheduled for PRI and PPRI while
+ * waiting_q is in use
+ *
+ * Works like next_job_no_preempt and next_job_preempt, but takes candidates
+ * from the front of waiting_q instead of runnable_q.  Jobs come out in
+ * (priority, arrival) order.  Once the best waiting job can neither get an
+ * idle core nor preempt anyone, no job behind it can either, so the loop
+ * stops there.
+ *
+ * A preempted job goes straight back into waiting_q.  It always ranks after
+ * the job that preempted it, so the loop reaches it only if it can in turn
+ * preempt someone.  Having been at the front of its bucket when it got its
+ * core, it usually goes back in at the front, which bucketq_offer does in
+ * O(1).
+ *
+ * @param time An integer representing the current time
+ * @param preempt Non-zero if waiting jobs may preempt running ones
+ */
+void next_job_bucketed(scheduler_t *s, int time, int preempt){
+
+	job_t *next_job;
+	job_t *old_job;
+	int idle = get_idle_core(s);
+
+	while(NULL != (next_job = (job_t*)bucketq_peek(s->waiting_q))){
+
+		if(0 <= idle){
+			bucketq_remove(s->waiting_q, next_job->waiting);
+			next_job->waiting = NULL;
+			update_core(s, idle, next_job, time);
+
+			idle = get_idle_core(s);
+		}
+		else if(preempt && NULL != (old_job = get_preempt_job(s, next_job))){
+			bucketq_remove(s->waiting_q, next_job->waiting);
+			next_job->waiting = NULL;
+
+			int core = preempt_job(s, old_job, time);
+
+			if(DEBUG){
+				printf("Job %d will preempt job %d on core %d...\n", next_job->number, old_job->number, core);
+			}
+			update_core(s, core, next_job, time);
+			old_job->waiting = bucketq_offer(s->waiting_q, old_job, old_job->priority, old_job->arrival_order);
+		}
+		else{
+			break;
+		}
+	}
+}
+
+
+/**
+ * @brief Determines the next job to be scheduled for preemptive schemes
+ * 
+ * @param new_job An artifact from earlier versions that I was too lazy to
+ * 		  remove
+ *
+ * @param time An integer representing the current time		  
+ *
+ * Takes candidates from the front of runnable_q.  Each one gets an idle
+ * core, or preempts the least important running job if it trumps it.  Once
+ * the best waiting job can do neither, no job behind it can either, so the
+ * loop stops there.  A preempted job goes back into runnable_q, behind the
+ * job that preempted it.
+ */
+void next_job_preempt(scheduler_t *s, job_t *new_job, int time){
 	
-						// printf("No idle cores available, checking for preemption...\n");
+	job_t *next_job;
+	job_t *old_job;
 
-						// To preserve priority, find
-						// the least important task
+	while(NULL != (next_job = runnableq_peek(s->runnable_q))){
 
-						job_t *old_job = get_preempt_job(next_job);
-						if(NULL != old_job){
-							// Preempt the job
-   							int core = old_job->core;
-							
-							// update its time
-							update_running_time(old_job, time);
+		// If an idle core exists, assign this job to that core
+		int idle = get_idle_core(s);
 
-							// Reset its core
-							old_job->core = -1;
-							
-							// Reset its active
-							// time to ensure
-							// proper running time
-							// accounting
-							old_job->value[6] = -1;
-
-
-							// If the job has yet
-							// to run, reset its
-							// latency
-							if(0 == old_job->value[4]){
-								old_job->value[7] = -1;	
-							}
-
-							if(DEBUG){
-								printf("Job %d will preempt job %d on core %d...\n", next_job->value[0], old_job->value[0], core);
-								printf("Updating core %d, currently running: %d\n", core, active_core[core]);
-							}
-							update_core(core, next_job);
-							if(DEBUG){
-								printf("Core %d is now running job %d\n", core, active_core[core]);
-							}
-
-						}
-						else if(DEBUG){
-							printf("No preemptable jobs found...\n");	
-						}
-					}// End else
-				}// End if (0 < next_job->core)
+		if(0 <= idle){
+			runnableq_poll(s->runnable_q);
+			if(DEBUG){
+				printf("Updating core %d, currently running: %d\n", idle, s->active_core[idle]);
 			}
-			else if(DEBUG){
-				printf("Job %d is finished, moving on...\n", next_job->value[0]);	
+			update_core(s, idle, next_job, time);
+		}
+		else if(NULL != (old_job = get_preempt_job(s, next_job))){
+			// Otherwise, preempt the least important running job
+			runnableq_poll(s->runnable_q);
+			int core = preempt_job(s, old_job, time);
+
+			if(DEBUG){
+				printf("Job %d will preempt job %d on core %d...\n", next_job->number, old_job->number, core);
+			}
+			update_core(s, core, next_job, time);
+			make_runnable(s, old_job);
+		}
+		else{
+			if(DEBUG){
+				printf("No preemptable jobs found...\n");
 			}
-		}// End for
-	} // End if(length > 0)
+			break;
+		}
+	}
 }
 
 
@@ -678,147 +1589,598 @@ void next_job_preempt(job_t *new_job, int time){
  *
  * See notes
  */
-void next_job_RR(job_t *new_job, int time){
+void next_job_RR(scheduler_t *s, job_t *new_job, int time){
 
 	// Main idea:
 	//   Since the new jobs are never run right away, there is no need to
 	//   make this more complicated.  New jobs are simply added to the
-	//   back of the list.  The next job is always at the front, the first
-	//   job which is not finished and not already running.
+	//   back of the run list.  The next job is always at the front.
 	//
 	//   In the event of a quantum timer expiring, simply move that one to
-	//   the back and update the time.  When a job finishes, mark it as
-	//   such and leave it be.
+	//   the back.  When a job finishes, it leaves the queue.
+
+	job_t* next_job;
+	int idle = get_idle_core(s);
+
+	while(0 <= idle && NULL != (next_job = run_list_pop(&s->run_list))){
+		update_core(s, idle, next_job, time);
+		idle = get_idle_core(s);
+	}
+}
+
+
+/**
+ * @brief Returns the most important MLFQ level with a job waiting, or -1 if
+ * no job is waiting
+ */
+int mlfq_top_level(scheduler_t *s){
+	for(int i = 0; i < MLFQ_LEVELS; ++i){
+		if(0 < s->levels[i].size){
+			return i;
+		}
+	}
+	return -1;
+}
+
+
+/**
+ * @brief Takes the job at the front of an MLFQ level
+ *
+ * A job boosted while it waited still carries its old level, and learns
+ * its new one here.
+ */
+job_t *mlfq_pop(scheduler_t *s, int level){
+	job_t *job = run_list_pop(&s->levels[level]);
+	if(job->level != level){
+		job->level = level;
+		job->quanta_used = 0;
+	}
+	return job;
+}
+
+
+/**
+ * @brief Returns the running job on the least important MLFQ level, if that
+ * level is below the one given, or NULL.  On a tie the lowest core wins.
+ */
+job_t *mlfq_preempt_job(scheduler_t *s, int level){
+	job_t *victim = NULL;
+	for(int i = 0; i < s->num_cores; ++i){
+		if(0 > s->active_core[i]){
+			continue;
+		}
+		job_t *job = get_job(s, s->active_core[i]);
+		if(job->level > level && (NULL == victim || job->level > victim->level)){
+			victim = job;
+		}
+	}
+	return victim;
+}
+
+
+/**
+ * @brief Determines the next jobs to run under MLFQ
+ *
+ * The front job of the most important non-empty level takes an idle core,
+ * or preempts a job running on a less important level.  A preempted job
+ * keeps its level and the quanta it has used, and goes to the back of its
+ * level.
+ *
+ * @param time An integer representing the current time
+ */
+void next_job_MLFQ(scheduler_t *s, int time){
+
+	job_t *next_job;
+	job_t *old_job;
+	int level;
+
+	while(0 <= (level = mlfq_top_level(s))){
+
+		int idle = get_idle_core(s);
+		if(0 <= idle){
+			next_job = mlfq_pop(s, level);
+			update_core(s, idle, next_job, time);
+		}
+		else if(NULL != (old_job = mlfq_preempt_job(s, level))){
+			next_job = mlfq_pop(s, level);
+			int core = preempt_job(s, old_job, time);
+
+			if(DEBUG){
+				printf("Job %d will preempt job %d on core %d...\n", next_job->number, old_job->number, core);
+			}
+			update_core(s, core, next_job, time);
+			make_runnable(s, old_job);
+		}
+		else{
+			break;
+		}
+	}
+}
+
+
+/**
+ * @brief Moves every job back to MLFQ level 0 once a boost period has
+ * passed, so that jobs demoted by long bursts get another chance
+ *
+ * Waiting jobs keep their order, more important levels first.  Each level
+ * is spliced onto level 0 in O(1), and the waiting jobs pick up their new
+ * level when they leave it, see mlfq_pop.  Only the running jobs are
+ * visited.
+ *
+ * @param time An integer representing the current time
+ */
+void mlfq_boost(scheduler_t *s, int time){
+
+	if(time < s->next_boost){
+		return;
+	}
+	s->next_boost = (time / MLFQ_BOOST + 1) * MLFQ_BOOST;
+
+	for(int i = 1; i < MLFQ_LEVELS; ++i){
+		run_list_splice(&s->levels[0], &s->levels[i]);
+	}
+
+	for(int i = 0; i < s->num_cores; ++i){
+		if(0 <= s->active_core[i]){
+			job_t *job = get_job(s, s->active_core[i]);
+			job->level = 0;
+			job->quanta_used = 0;
+		}
+	}
+
+	if(DEBUG){
+		printf("Boosted every job to level 0 at time %d\n", time);
+	}
+}
+
+
+// CFS weight for priorities 0 to 19, each about 1.25 times lighter than the
+// one before, as for Linux nice values 0 to 19
+static const int cfs_weights[] = {
+	1024, 820, 655, 526, 423, 335, 272, 215, 172, 137,
+	 110,  87,  70,  56,  45,  36,  29,  23,  18,  15,
+};
+
+#define CFS_NUM_WEIGHTS ((int)(sizeof(cfs_weights) / sizeof(cfs_weights[0])))
+
+
+/**
+ * @brief Charges a running job under CFS for the time it ran since it was
+ * last accounted for, in remaining and in virtual runtime
+ *
+ * Priorities beyond the weight table get the weight of its nearest end.
+ *
+ * @param time An integer representing the current time
+ */
+void cfs_account(job_t *job, int time){
+	if(0 <= job->last_active){
+		int p = job->priority;
+		int weight = cfs_weights[(0 > p) ? 0 : (CFS_NUM_WEIGHTS <= p) ? CFS_NUM_WEIGHTS - 1 : p];
+		job->vruntime += (time - job->last_active) * CFS_NICE0_WEIGHT / weight;
+	}
+	update_running_time(job, time);
+}
+
+
+/**
+ * @brief Returns the CFS slice in quanta of the simulator
+ *
+ * Every job that has arrived and not finished could run, and the cores share
+ * them, so each gets
+ * CFS_LATENCY over its share of the runnable jobs, at least
+ * CFS_MIN_GRANULARITY.
+ */
+int cfs_slice(scheduler_t *s){
+	int slice = CFS_LATENCY * s->num_cores / s->job_index_size;
+	return (CFS_MIN_GRANULARITY < slice) ? slice : CFS_MIN_GRANULARITY;
+}
+
+
+/**
+ * @brief Determines the next jobs to run under CFS
+ *
+ * Each idle core takes the job with the least virtual runtime from cfs_q.
+ * A job only gives up its core when its slice ends, see cfs_expire.
+ *
+ * @param time An integer representing the current time
+ */
+void next_job_CFS(scheduler_t *s, int time){
+
+	job_t *next_job;
+	int idle = get_idle_core(s);
+
+	while(0 <= idle && NULL != (next_job = cfsq_poll(&s->cfs_q))){
+		update_core(s, idle, next_job, time);
+		idle = get_idle_core(s);
+	}
+}
+
+
+/**
+  Creates a scheduler.  Any number of schedulers may exist at once, and
+  schedulers share no state, so separate threads may each drive their own.
+  Several threads may also deliver arrivals, finishes and quantum expirations
+  to the same scheduler at once.  The statistics, scheduler_show_queue_r and
+  scheduler_destroy expect no such calls in flight.
+
+  Assumptions:
+    - You may assume that cores is a positive, non-zero number.
+    - You may assume that scheme is a valid scheduling scheme.
+
+  @param cores the number of cores that is available by the scheduler. These
+  	 cores will be known as core(id=0), core(id=1), ..., core(id=cores-1).
+  @param scheme  the scheduling scheme that should be used. This value will
+  		 be one of the eight enum values of scheme_t
+  @return the new scheduler, to be released with scheduler_destroy
+*/
+scheduler_t *scheduler_create(int cores, scheme_t scheme){
+	return scheduler_create_queues(cores, scheme, GLOBAL_QUEUE);
+}
+
+
+/**
+  Creates a scheduler like scheduler_create, choosing how waiting jobs are
+  queued.
+
+  Under GLOBAL_QUEUE every decision is made against the whole ready queue.
+  Under PER_CORE_QUEUES each core has its own run queue in policy order.
+  Arrivals go to an idle core or the least loaded run queue, a core that
+  frees up takes the front of its own run queue, and a core whose run queue
+  is empty steals from the tail of the busiest one.  The cost of a decision
+  then depends on the number of cores rather than on the depth of the queue,
+  at the price of only approximating the global policy order.
+
+  @param cores the number of cores that is available by the scheduler
+  @param scheme the scheduling scheme that should be used
+  @param queues how jobs waiting for a core are queued
+  @return the new scheduler, to be released with scheduler_destroy
+*/
+scheduler_t *scheduler_create_queues(int cores, scheme_t scheme, queue_mode_t queues){
+
+	scheduler_t *s = (scheduler_t *)malloc(sizeof(scheduler_t));
+	if(NULL == s){
+		fprintf(stderr, "Out of memory.\n");
+		exit(2);
+	}
+
+	// Set up core tracker, initialized to idle
+	s->active_core = (int *)malloc(cores*sizeof(int));
+	s->idle_words = (cores + 63) / 64;
+	s->idle_cores = (unsigned long long *)calloc(s->idle_words, sizeof(unsigned long long));
+	for(int i = 0; i<cores; ++i){
+		set_core_idle(s, i);
+	}
+
+	s->num_cores = cores;
+
+	s->policy = scheme;
+
+	s->waiting_q = NULL;
+	s->run_queues = NULL;
+	s->runnable_q = NULL;
+	s->run_list.tail = NULL;
+	s->run_list.size = 0;
+	for(int i = 0; i < MLFQ_LEVELS; ++i){
+		s->levels[i].tail = NULL;
+		s->levels[i].size = 0;
+	}
+	s->next_boost = MLFQ_BOOST;
+	cfsq_init(&s->cfs_q, 0);
+	s->min_vruntime = 0;
+	s->arrivals = 0;
+	s->running = NULL;
+	s->num_running = 0;
+	atomic_init(&s->pending, NULL);
+	pthread_mutex_init(&s->combiner, NULL);
+	s->now = 0;
+	if(PER_CORE_QUEUES == queues && MLFQ != s->policy && CFS != s->policy){
+		s->run_queues = (run_queue_t *)calloc(cores, sizeof(run_queue_t));
+	}
+	else if(RR != s->policy && MLFQ != s->policy && CFS != s->policy){
+		s->runnable_q = (runnableq_t *)malloc(sizeof(runnableq_t));
+		runnableq_init(s->runnable_q, 0);
+		if(PSJF == s->policy || PPRI == s->policy){
+			s->running = (job_t **)malloc(cores * sizeof(job_t *));
+		}
+	}
+	job_index_init(s, 4);
+	s->job_slabs = NULL;
+	s->free_jobs = NULL;
+	s->job_bump = NULL;
+	s->job_bump_left = 0;
+	s->job_slab_size = JOB_MIN_SLAB;
+	s->stats = NULL;
+	s->num_slots = 0;
+	s->stats_size = 0;
+	s->completed = 0;
+	s->total_waiting = 0;
+	s->total_turnaround = 0;
+	s->total_response = 0;
+	if(NULL == s->run_queues && (PRI == s->policy || PPRI == s->policy)){
+		s->waiting_q = (bucketq_t *)malloc(sizeof(bucketq_t));
+		bucketq_init(s->waiting_q, PRI_BUCKETS);
+	}
+
+	if(DEBUG){
+		printf("Cores:\t");
+		for(int i = 0; i<s->num_cores; i++){printf("%d ", s->active_core[i]);}
+		printf("\n");
+	}
+	return s;
+}
+
+
+/**
+ * @brief Creates a job that just arrived and adds it to job_index
+ * and wherever jobs wait for a core.  The job is not given a core.
+ *
+ * @return The new job
+ */
+job_t *add_job(scheduler_t *s, int job_number, int time, int running_time, int priority){
+
+	// Create and initialize job
+	job_t* daJob 	= job_alloc(s);
+	daJob->number	= job_number;		// UUID
+	daJob->remaining = running_time;	// Time left to run
+	daJob->priority	= priority;		// Priority
+	daJob->last_active = -1;		// Last active time
+
+	job_stats_t *stats = &s->stats[daJob->slot];
+	stats->arrival	= time;			// Arrival time
+	stats->burst	= running_time;		// Burst
+	stats->latency	= -1;			// Scheduling latency
+
+	daJob->core	= -1;			// Active core
+	daJob->level	= 0;			// MLFQ level
+	daJob->quanta_used = 0;
+	if(CFS == s->policy){
+		daJob->vruntime = s->min_vruntime;
+	}
+	daJob->waiting	= NULL;
+	daJob->home	= -1;
+	daJob->arrival_order = s->arrivals++;
+
+	if(NULL != s->waiting_q && (0 > priority || PRI_BUCKETS <= priority)){
+		// Out of range, fall back to runnable_q from now on
+		bucketq_t *waiting_q = s->waiting_q;
+		s->waiting_q = NULL;
+
+		job_t *job;
+		while(NULL != (job = (job_t *)bucketq_poll(waiting_q))){
+			job->waiting = NULL;
+			make_runnable(s, job);
+		}
+		bucketq_destroy(waiting_q);
+		free(waiting_q);
+	}
+	if(NULL == s->run_queues){
+		make_runnable(s, daJob);
+	}
+
+	if(DEBUG){
+		print_queue(s);
+	}
 
-	job_t* next_job = NULL;
-	int length = priqueue_size(ready_q);
-	int found;
-	if(0 < length){
+	index_job(s, daJob);
 	
-		// If not empty, search through the queue
-		// Everything should be sorted by arrival automatically by
-		// priqueue_offer
-		int idle = get_idle_core();
-
-		while(9000 != idle){
-			found = 0;
-			for(int i = 0; i<length; ++i){
-				next_job = (job_t*)priqueue_at(ready_q, i);
-		
-				if(NULL == next_job){
-					printf("SOMETHING IS VERY WRONG...\n");
-					printf("currently inspecting index %d\n", i);
-					printf("core %d is idle\n", idle);
-					printf("Priqueue has %d elements\n", priqueue_size(ready_q));
-					assert(0);
-				}
-				// If the current job is not finished..
-				if(next_job->finished != 1){
-		
-					if(DEBUG){
-						printf("Job %d is not finished(%d)...\n", next_job->value[0], next_job->finished);
-					}
-				
-					// and it is not already running...
-					if(0 > next_job->core){
-				
-						if(DEBUG){
-							printf("and not running, it will be the next job...\n");
-						}
-						found = 1;
-						break;
-					}
-					else if(DEBUG){
-						printf("Job %d is running, moving on...\n", next_job->value[0]);
-					}
-				}
-				else if(DEBUG){
-					printf("Job %d is finished, moving on...\n", next_job->value[0]);	
-				}
+	if(DEBUG){
+		print_queue(s);
+	
+		printf("Inserted new job %d\n", daJob->number);
+
+		printf("Current number of jobs is: %d\n", s->job_index_size);
+	}
+	return daJob;
+}
+
+
+/**
+ * @brief Fills idle cores, and under PSJF and PPRI preempts, from runnable_q,
+ * waiting_q, cfs_q or the run lists according to the policy
+ *
+ * @param time An integer representing the current time
+ */
+void dispatch(scheduler_t *s, int time){
+
+	switch(s->policy){
+		case FCFS:
+		case PRI:
+		case SJF:
+			if(NULL != s->waiting_q){
+				next_job_bucketed(s, time, 0);
 			}
+			else{
+				next_job_no_preempt(s, NULL, time);
+			}
+			break;
+		case PSJF:
+		case PPRI:
+			if(NULL != s->waiting_q){
+				next_job_bucketed(s, time, 1);
+			}
+			else{
+				next_job_preempt(s, NULL, time);
+			}
+			break;
+		case MLFQ:
+			next_job_MLFQ(s, time);
+			break;
+		case CFS:
+			next_job_CFS(s, time);
+			break;
+		default:
+			next_job_RR(s, NULL, time);
+	}
+}
+
+
+/**
+ * @brief Folds a finished job into the statistics, frees its core and
+ * forgets it.  The core is left idle.
+ *
+ * Under PSJF and PPRI the running jobs must have been refreshed first.
+ */
+void retire_job(scheduler_t *s, int core_id, int job_number, int time){
+
+	job_t* curr_job;
+
+	// Find and update the job in question
+	curr_job = get_job(s, job_number);
+
+	if(NULL != s->running){
+		running_remove(s, curr_job);
+	}
+	
+	if(DEBUG){
+		printf("Job finished: %d\n", curr_job->number);
+	}
+	
+	// Retire the job: fold it into the statistics and take it out of the
+	// queue so that no later scan has to walk past it
+	job_stats_t *stats = &s->stats[curr_job->slot];
+	int turnaround = time - stats->arrival;
+	s->completed++;
+	s->total_turnaround += turnaround;
+	s->total_waiting += turnaround - stats->burst;
+	s->total_response += stats->latency;
+
+	if(DEBUG){
+		printf("Job %d waited %d, took %d and responded after %d time units\n", curr_job->number, turnaround - stats->burst, turnaround, stats->latency);
+		printf("Freeing core %d, currently running job %d...\n", core_id, s->active_core[core_id]);
+	}
+	
+	// Free the core for downstream helpers
+	set_core_idle(s, core_id);
+
+	unindex_job(s, curr_job);
+	job_release(s, curr_job);
+}
+
+
+/**
+ * @brief Takes the job whose quantum expired off its core and moves it to the
+ * back of the jobs waiting for one.  The core is left idle.
+ *
+ * @param current_job The job running on core_id
+ */
+void rotate_job(scheduler_t *s, job_t *current_job, int core_id, int time){
+
+	set_core_idle(s, core_id);
+
+	// update its time
+	update_running_time(current_job, time);
+
+	// Reset its core
+	current_job->core = -1;
+							
+	// Reset its active time to ensure proper running time accounting
+	current_job->last_active = -1;
+
+
+	// If the job has yet to run, reset its latency
+	if(s->stats[current_job->slot].burst == current_job->remaining){
+		s->stats[current_job->slot].latency = -1;
+	}
+	
+	if(DEBUG){
+		printf("Moving old job to back of queue...\n");
+	}
+
+	// Move the old job behind every other job waiting for a core
+	make_runnable(s, current_job);
+}
+
+
+/**
+ * @brief Handles a quantum expiring on a core under PER_CORE_QUEUES
+ *
+ * The core moves on to the front of its run queue, or a stolen job, and
+ * its current job goes to the back of its run queue.  With nothing else to
+ * run, the current job stays.
+ */
+void expire_local(scheduler_t *s, int core_id, int time){
+
+	job_t *current_job = get_job(s, s->active_core[core_id]);
+
+	// Rotate through this core's run queue, or a stolen job
+	job_t *other_job = take_local(s, core_id);
+	if(NULL == other_job){
+		return;
+	}
+	preempt_job(s, current_job, time);
+	set_core_idle(s, core_id);
+	enqueue_local(s, core_id, current_job);
+	update_core(s, core_id, other_job, time);
+}
+
+
+/**
+ * @brief Handles a quantum expiring on a core under MLFQ
+ *
+ * The job keeps its core until it has used the quantum of its level,
+ * (1 << level) quanta of the simulator.  Then it is demoted one level.  If
+ * a job waits on its new level or a more important one, it goes to the back
+ * of its new level and core_id takes the front job of the most important
+ * one.  Otherwise it stays on core_id, even if other cores are idle.
+ */
+void mlfq_expire(scheduler_t *s, int core_id, int time){
 
-			if(found){
-				if(DEBUG){
-					printf("Updating core %d, currently running: %d\n", idle, active_core[idle]);
-				}
-				update_core(idle, next_job);
-				if(DEBUG){
-					printf("Core %d is now running job %d\n", idle, active_core[idle]);
-				}
-				
+	job_t *current_job = get_job(s, s->active_core[core_id]);
 
-				// Update last active time to next time cycle
-				next_job->value[6] = time;
+	if(++current_job->quanta_used < (1 << current_job->level)){
+		return;
+	}
+	if(MLFQ_LEVELS - 1 > current_job->level){
+		current_job->level++;
+	}
+	current_job->quanta_used = 0;
 
+	if(DEBUG){
+		printf("Job %d demoted to level %d\n", current_job->number, current_job->level);
+	}
 
-				idle = get_idle_core();
-			}
-			else{
-				if(DEBUG){
-					printf("No valid jobs found to schedule\n");
-				}
-				break;
-			}
-		}// End while
-	}// End if(0 < length)
+	int level = mlfq_top_level(s);
+	if(0 > level || level > current_job->level){
+		return;
+	}
+	rotate_job(s, current_job, core_id, time);
+	update_core(s, core_id, mlfq_pop(s, level), time);
 }
 
 
 /**
-  Initalizes the scheduler.
- 
-  Assumptions:
-    - You may assume this will be the first scheduler function called.
-    - You may assume this function will be called once once.
-    - You may assume that cores is a positive, non-zero number.
-    - You may assume that scheme is a valid scheduling scheme.
+ * @brief Handles a quantum expiring on a core under CFS
+ *
+ * The job keeps its core until it has used its slice, see cfs_slice.  Then
+ * its virtual runtime is brought up to date, and it goes back to cfs_q for
+ * dispatch if a waiting job has run less, weighted.  Otherwise it
+ * starts another slice.
+ */
+void cfs_expire(scheduler_t *s, int core_id, int time){
 
-  @param cores the number of cores that is available by the scheduler. These
-  	 cores will be known as core(id=0), core(id=1), ..., core(id=cores-1).
-  @param scheme  the scheduling scheme that should be used. This value will
-  		 be one of the six enum values of scheme_t
-*/
-void scheduler_start_up(int cores, scheme_t scheme){
+	job_t *current_job = get_job(s, s->active_core[core_id]);
 
-	// Set up global core tracker, initialized to zeros
-	active_core = (int *)malloc(cores*sizeof(int));
-	for(int i = 0; i<cores; ++i){
-		active_core[i] = -1;
+	if(++current_job->quanta_used < cfs_slice(s)){
+		return;
 	}
+	current_job->quanta_used = 0;
+	cfs_account(current_job, time);
 
-	NUM_CORES = cores;
+	// The front of cfs_q has the least virtual runtime of the waiting jobs
+	job_t *next_job = cfsq_peek(&s->cfs_q);
+	int yield = (NULL != next_job && 0 > cfs_cmp(&next_job->vruntime, &current_job->vruntime));
 
-	// Set up global ready queue on the heap
-	ready_q = (priqueue_t *)malloc(sizeof(priqueue_t));
-
-	policy = scheme;
-
-	switch(policy){
-		case FCFS:
-			priqueue_init(ready_q, comparison_FCFS);
-			break;
-		case SJF:
-			priqueue_init(ready_q, comparison_SJF);
-			break;
-		case PSJF:
-			priqueue_init(ready_q, comparison_PSJF);
-			break;
-		case PRI:
-			priqueue_init(ready_q, comparison_PRI);
-			break;
-		case PPRI:
-			priqueue_init(ready_q, comparison_PPRI);
-			break;
-		default:
-			// Round robin
-			priqueue_init(ready_q, comparison_RR);
-			break;
+	// Arrivals start no earlier than the least virtual runtime in play
+	job_t *least = yield ? next_job : current_job;
+	if(0 < (int)((unsigned int)least->vruntime - (unsigned int)s->min_vruntime)){
+		s->min_vruntime = least->vruntime;
 	}
-	if(DEBUG){
-		printf("Created new queue with %d elements\n", priqueue_size(ready_q));
-		printf("Cores:\t");
-		for(int i = 0; i<NUM_CORES; i++){printf("%d ", active_core[i]);}
-		printf("\n");
+
+	if(yield){
+		if(DEBUG){
+			printf("Job %d yields to job %d at virtual runtime %d\n", current_job->number, next_job->number, current_job->vruntime);
+		}
+		rotate_job(s, current_job, core_id, time);
 	}
 }
 
@@ -839,6 +2201,7 @@ void scheduler_start_up(int cores, scheme_t scheme){
   	  everything on this end for execution immediately.
 
 
+  @param s the scheduler
   @param job_number a globally unique identification number of the job arriving.
   @param time the current time of the simulator.
   @param running_time the total number of time units this job will run before
@@ -849,37 +2212,18 @@ void scheduler_start_up(int cores, scheme_t scheme){
   @return -1 if no scheduling changes should be made. 
  
  */
-int scheduler_new_job(int job_number, int time, int running_time, int priority){
-
-	// Create and initialize job
-	job_t* daJob 	= (job_t*)malloc(sizeof(job_t));
-	daJob->value[0] = job_number;		// UUID
-	daJob->value[1] = time;			// Arrival time
-	daJob->value[2] = running_time;		// Burst
-	daJob->value[3] = priority;		// Priority
-	daJob->value[4] = 0;			// Cumulative running time
-	daJob->value[5] = 0;			// End time
-	daJob->value[6] = -1;			// Last active time
-	daJob->value[7] = -1;			// Scheduling latency
-
-	daJob->core	= -1;			// Active core
-	daJob->finished = 0;			// Complete/Incomplete
+static int apply_new_job(scheduler_t *s, int job_number, int time, int running_time, int priority){
 
-	if(DEBUG){
-		print_queue();
+	// Jobs on a core are compared with the new one as they are now
+	if(NULL != s->running){
+		refresh_running(s, time);
+	}
+	if(MLFQ == s->policy){
+		mlfq_boost(s, time);
 	}
 
-	// Add the new Job to the back of the queue
-	int status = priqueue_offer(ready_q, daJob);
-	
-	if(DEBUG){
-		print_queue();
-	
-		printf("Inserted new job at position %d\n", status);
+	job_t *daJob = add_job(s, job_number, time, running_time, priority);
 
-		printf("Current ready queue size is: %d\n", priqueue_size(ready_q));
-	}
-	
 	// Determine and set up for the next round of jobs.  It is assumed
 	// that by this point, all inactive jobs have been destroyed, and that
 	// this method call is the last step before the next execution
@@ -888,26 +2232,15 @@ int scheduler_new_job(int job_number, int time, int running_time, int priority){
 	// Each of the methods below acts accordingly, updating all known jobs
 	// to their correct cores and statuses.
 
-	switch(policy){
-		case RR:
-			next_job_RR(daJob, time);
-			break;
-		case PPRI:
-		case PSJF:
-			next_job_preempt(daJob, time);
-			break;
-		case SJF:
-		case PRI:
-		case FCFS:
-			next_job_no_preempt(daJob, time);
-			break;
+	if(NULL != s->run_queues){
+		place_job_local(s, daJob, time);
+	}
+	else{
+		dispatch(s, time);
 	}
-
-	// Update time for all jobs
-	update_time(time);
 
 	// The job in question will have its core already assigned
-	return get_job(job_number)->core;
+	return daJob->core;
 }
 
 
@@ -924,73 +2257,33 @@ int scheduler_new_job(int job_number, int time, int running_time, int priority){
   		this end.  There may be several such calls due to the way the
 		simulator is written.
 
+  @param s the scheduler
   @param core_id the zero-based index of the core where the job was located.
   @param job_number a globally unique identification number of the job.
   @param time the current time of the simulator.
   @return job_number of the job that should be scheduled to run on core core_id
   @return -1 if core should remain idle.
  */
-int scheduler_job_finished(int core_id, int job_number, int time){
+static int apply_job_finished(scheduler_t *s, int core_id, int job_number, int time){
 
-	job_t* curr_job;
-
-	// Find and update the job in question
-	curr_job = get_job(job_number);
-	
-	if(DEBUG){
-		printf("Job finished: %d\n", curr_job->value[0]);
+	if(NULL != s->running){
+		refresh_running(s, time);
 	}
-	
-	// Update ended time
-	curr_job->value[5] = time;
-
-	// Mark complete
-	curr_job->finished = 1;
-
-	// Hacky hack
-	// Need to ensure that final jobs do not influence new job placement
-	// in preemptive priority scheme.  By setting this to maximum
-	// priority, the new job will always make it past the the finished
-	// jobs and compare to at least one incomplete job.
-	curr_job->value[3] = 0;
-
-	if(DEBUG){
-		printf("Freeing core %d, currently running job %d...\n", core_id, active_core[core_id]);
+	if(MLFQ == s->policy){
+		mlfq_boost(s, time);
 	}
-	
-	// Free the core for downstream helpers
-	active_core[core_id] = -1;
-	curr_job->core = -1;
+	retire_job(s, core_id, job_number, time);
 
 	// Update everything
-	switch(policy){
-		case FCFS:
-		case PRI:
-		case SJF:
-			next_job_no_preempt(NULL, time);
-			break;
-		case PSJF:
-		case PPRI:
-			next_job_preempt(NULL, time);
-			break;
-		default:
-			next_job_RR(NULL, time);
-		
+	if(NULL != s->run_queues){
+		next_job_local(s, core_id, time);
+	}
+	else{
+		dispatch(s, time);
 	}
-
-
-	// Hacky hack
-	curr_job->finished = 0;
-
-	// Update time for all jobs
-	update_time(time);
-	
-	// end Hacky hack
-	curr_job->finished = 1;
-
 
 	// return the next item to run on the core in question, or -1 if idle
-	return active_core[core_id];
+	return s->active_core[core_id];
 }
 
 
@@ -1005,136 +2298,330 @@ int scheduler_job_finished(int core_id, int job_number, int time){
   NOTE - not in the rubric, but there is some ill-defined behavior:
   	If no other jobs exist, a job should not be preempted at all.
 
+  @param s the scheduler
   @param core_id the zero-based index of the core where the quantum has expired.
   @param time the current time of the simulator. 
   @return job_number of the job that should be scheduled on core cord_id
   @return -1 if core should remain idle
  */
-int scheduler_quantum_expired(int core_id, int time){
+static int apply_quantum_expired(scheduler_t *s, int core_id, int time){
 	
 	if(DEBUG){
 		printf("Quantum time expired for core %d\n", core_id);
 	}
 
-	scheduler_show_queue();
-	
-	job_t * current_job;
-	int position = -1;
-	int no_other_jobs = 0;
-
-
 	// Find the currently running job
-	int current_job_number = active_core[core_id];
+	int current_job_number = s->active_core[core_id];
 	assert(current_job_number >= 0);
-	
-	// Verify that it exists...
-	current_job = (job_t*)get_job(current_job_number);
-	assert(NULL!=current_job);
-
-	// Review each job to find the position of the current job, 
-	// and to determine if there are any jobs besides the currently running job
-	for(int i = 0; i<priqueue_size(ready_q); ++i){
-		current_job = priqueue_at(ready_q, i);
-		if(active_core[core_id] == current_job->value[0]){
-			// Mark position of currently running job
-			position = i;
-		}
-		else{
-			if(!current_job->finished){
-				// and not already running...
-				if(0 > current_job->core){
-					no_other_jobs = 1;
-				}
-			}
-		}
+
+	if(NULL != s->run_queues){
+		expire_local(s, core_id, time);
+		return s->active_core[core_id];
 	}
-	assert(position >= 0);
-	
-	// If there are no other active jobs, there is nothing to do
-	if(!no_other_jobs){
+
+	// MLFQ demotes the job even when nothing else waits
+	if(MLFQ == s->policy){
+		mlfq_boost(s, time);
+		mlfq_expire(s, core_id, time);
+		dispatch(s, time);
+		return s->active_core[core_id];
+	}
+
+	// CFS counts every quantum towards the slice, and decides by virtual
+	// runtime rather than by whether anything waits
+	if(CFS == s->policy){
+		cfs_expire(s, core_id, time);
+		dispatch(s, time);
+		return s->active_core[core_id];
+	}
+
+	// If there are no other jobs waiting, there is nothing to do
+	if(0 == waiting_jobs(s)){
 		return current_job_number;	
 	}
 
+	rotate_job(s, get_job(s, current_job_number), core_id, time);
+
+	// Call to schedule the next job to run
+	dispatch(s, time);
+
 	if(DEBUG){
-		printf("Removing running job %d at position %d, current size is %d...\n", active_core[core_id], position, priqueue_size(ready_q));
+		printf("Done with quantum expired...\n");
+		print_queue(s);
 	}
+	
+	return s->active_core[core_id];
+}
 
-	current_job = (job_t*)priqueue_remove_at(ready_q, position);
 
-	if(DEBUG){
-		printf("Job %d removed, current size is %d, updating metrics...\n", current_job->value[0], priqueue_size(ready_q));
+/**
+  Applies every event of one time unit at once, see scheduler_tick_r.
+  Finished jobs are retired, expired jobs rotated and arrivals added, and
+  only then are the cores filled, by one pass of dispatch.
+*/
+static void apply_tick(scheduler_t *s, int time,
+                       const arrival_t *arrivals, int num_arrivals,
+                       const completion_t *completions, int num_completions,
+                       const int *expirations, int num_expirations,
+                       int *assignment){
+
+	if(NULL != s->running){
+		refresh_running(s, time);
+	}
+	if(MLFQ == s->policy){
+		mlfq_boost(s, time);
 	}
 
-	if(current_job->value[0] != active_core[core_id]){
-		printf("Sanity check failed in quantum expired...\n");
-		printf("The job removed %d does not match the expected job %d\n", current_job->value[0], active_core[core_id]);
-		assert(0);
+	if(NULL != s->run_queues){
+		// Per-core decisions only look at a few run queues, and there is
+		// no shared dispatch to save, so they are made one event at a time
+		for(int i = 0; i < num_completions; ++i){
+			retire_job(s, completions[i].core_id, completions[i].job_number, time);
+			next_job_local(s, completions[i].core_id, time);
+		}
+		for(int i = 0; i < num_expirations; ++i){
+			expire_local(s, expirations[i], time);
+		}
+		for(int i = 0; i < num_arrivals; ++i){
+			job_t *job = add_job(s, arrivals[i].job_number, time, arrivals[i].running_time, arrivals[i].priority);
+			place_job_local(s, job, time);
+		}
 	}
+	else{
+		for(int i = 0; i < num_completions; ++i){
+			retire_job(s, completions[i].core_id, completions[i].job_number, time);
+		}
 
-	active_core[core_id] = -1;
+		if(MLFQ == s->policy){
+			for(int i = 0; i < num_expirations; ++i){
+				mlfq_expire(s, expirations[i], time);
+			}
+		}
+		else if(CFS == s->policy){
+			for(int i = 0; i < num_expirations; ++i){
+				cfs_expire(s, expirations[i], time);
+			}
+		}
+		else if(0 < num_expirations){
+			// One call at a time, the cores freed above would take
+			// waiting jobs first, and an expiring job only gives up its
+			// core if a job is still waiting after that.  Rotating does
+			// not change how many wait, so either every expiring job
+			// rotates or none does.
+			if(waiting_jobs(s) > count_idle_cores(s)){
+				for(int i = 0; i < num_expirations; ++i){
+					int core_id = expirations[i];
+					rotate_job(s, get_job(s, s->active_core[core_id]), core_id, time);
+				}
+			}
+		}
 
-	// update its time
-	update_running_time(current_job, time);
+		for(int i = 0; i < num_arrivals; ++i){
+			add_job(s, arrivals[i].job_number, time, arrivals[i].running_time, arrivals[i].priority);
+		}
 
-	if(DEBUG){
-		printf("Time updated, checking job again...\n");
-		printf("Old job %d is OK...\n", current_job->value[0]);
+		dispatch(s, time);
 	}
 
-	// Reset its core
-	current_job->core = -1;
-							
-	// Reset its active time to ensure proper running time accounting
-	current_job->value[6] = -1;
+	memcpy(assignment, s->active_core, s->num_cores * sizeof(int));
+}
 
 
-	// If the job has yet to run, reset its latency
-	if(0 == current_job->value[4]){
-		current_job->value[7] = -1;	
-	}
-	
-	if(DEBUG){
-		printf("Adding old job to back of queue...\n");
+/**
+ * @brief Returns the time an event stamped with the given time is applied
+ * at, and moves the scheduler's clock up to it
+ *
+ * Running time is accounted lazily as the difference between two event
+ * times, so time must never run backwards.  An event stamped earlier than
+ * one already applied is taken to happen at the later time.
+ */
+static int clamp_time(scheduler_t *s, int time){
+	if(time < s->now){
+		if(DEBUG){
+			printf("Event at time %d applied at time %d\n", time, s->now);
+		}
+		return s->now;
 	}
+	s->now = time;
+	return time;
+}
 
-	// Add the old job to the back of the queue
-	priqueue_offer(ready_q, current_job);
 
-	if(DEBUG){
-		printf("Checking that the job is in fact in the queue...\n");
+/**
+ * @brief Applies every pending event
+ *
+ * Events are applied in time order, and within a time unit finishes come
+ * first, then quantum expirations, then arrivals, the order the simulator
+ * delivers them in.  Events that tie keep the order they were pushed in.
+ * Only called with combiner held.
+ *
+ * Only the events of one batch are sorted.  An event that reaches the
+ * scheduler after one with a later time has been applied is applied at that
+ * later time instead, see clamp_time.
+ */
+static void apply_pending(scheduler_t *s){
+
+	event_t *ev = atomic_exchange_explicit(&s->pending, NULL, memory_order_acquire);
+	event_t *batch = NULL;
+	event_t **at;
+
+	// The stack is newest first, so inserting each event ahead of those
+	// that tie with it leaves ties oldest first
+	while(NULL != ev){
+		event_t *next = ev->next;
+		at = &batch;
+		while(NULL != *at && ((*at)->time < ev->time ||
+		      ((*at)->time == ev->time && (*at)->kind < ev->kind))){
+			at = &(*at)->next;
+		}
+		ev->next = *at;
+		*at = ev;
+		ev = next;
 	}
 
-	int sanity_check = current_job->value[0];
+	while(NULL != batch){
+		// The caller may return as soon as done is set, taking the event
+		// with it
+		event_t *next = batch->next;
+		batch->time = clamp_time(s, batch->time);
+		switch(batch->kind){
+			case EVENT_FINISHED:
+				batch->result = apply_job_finished(s, batch->core_id, batch->job_number, batch->time);
+				break;
+			case EVENT_EXPIRED:
+				batch->result = apply_quantum_expired(s, batch->core_id, batch->time);
+				break;
+			default:
+				batch->result = apply_new_job(s, batch->job_number, batch->time, batch->running_time, batch->priority);
+				break;
+		}
+		atomic_store_explicit(&batch->done, 1, memory_order_release);
+		batch = next;
+	}
+}
 
-	current_job = (job_t *)get_job(sanity_check);
 
-	if(NULL == current_job){
-		printf("get_job returned NULL, The job was not properly inserted...\n");
-		assert(0);
+/**
+ * @brief Delivers an event to the scheduler and waits for its result
+ *
+ * The event goes onto the pending stack with a compare-and-swap.  The caller
+ * then blocks on combiner.  Whoever holds it applies everything pending, so
+ * by the time the caller gets it, its event has often been applied already;
+ * if not, it applies the whole batch, its own event included.  Callers
+ * sleep in the lock rather than spin, so they do not take CPU time from the
+ * one applying events.  The events are still applied one at a time, so
+ * more calling threads do not make more decisions per second.
+ *
+ * @param ev The event, filled in except for result, done and next
+ *
+ * @return The result of the call the event stands for
+ */
+static int submit(scheduler_t *s, event_t *ev){
+
+	atomic_init(&ev->done, 0);
+	ev->next = atomic_load_explicit(&s->pending, memory_order_relaxed);
+	while(!atomic_compare_exchange_weak_explicit(&s->pending, &ev->next, ev,
+	      memory_order_release, memory_order_relaxed)){
+		;
 	}
 
-	if(DEBUG){
-		printf("The job is in the queue\n");
-		printf("Scheduling next job...\n");
+	// Everything pushed before combiner was taken is applied before it is
+	// released, so one turn with it is enough
+	pthread_mutex_lock(&s->combiner);
+	if(!atomic_load_explicit(&ev->done, memory_order_acquire)){
+		apply_pending(s);
 	}
+	pthread_mutex_unlock(&s->combiner);
+	return ev->result;
+}
 
-	// Call to schedule the next job to run
-	next_job_RR(NULL, time);
+
+/**
+  Called when a new job arrives, see apply_new_job.  Safe to call from
+  several threads at once, together with scheduler_job_finished_r and
+  scheduler_quantum_expired_r.
+*/
+int scheduler_new_job_r(scheduler_t *s, int job_number, int time, int running_time, int priority){
+	event_t ev;
+	ev.kind = EVENT_ARRIVAL;
+	ev.time = time;
+	ev.job_number = job_number;
+	ev.running_time = running_time;
+	ev.priority = priority;
+	return submit(s, &ev);
+}
 
 
-	if(DEBUG){
-		printf("Updating time...\n");
-	}
+/**
+  Called when a job has completed execution, see apply_job_finished.  Safe to
+  call from several threads at once.
+*/
+int scheduler_job_finished_r(scheduler_t *s, int core_id, int job_number, int time){
+	event_t ev;
+	ev.kind = EVENT_FINISHED;
+	ev.time = time;
+	ev.core_id = core_id;
+	ev.job_number = job_number;
+	return submit(s, &ev);
+}
 
-	// Update time
-	update_time(time);
 
-	if(DEBUG){
-		printf("Done with quantum expired...\n");
-		print_queue();
-	}
-	
-	return active_core[core_id];
+/**
+  Called when the quantum timer has expired on a core, see
+  apply_quantum_expired.  Safe to call from several threads at once.
+*/
+int scheduler_quantum_expired_r(scheduler_t *s, int core_id, int time){
+	event_t ev;
+	ev.kind = EVENT_EXPIRED;
+	ev.time = time;
+	ev.core_id = core_id;
+	return submit(s, &ev);
+}
+
+
+/**
+  Delivers every event of one time unit at once: the jobs that finished, the
+  cores whose quantum expired and the jobs that arrived.  Finished jobs are
+  retired, then expired jobs give up their core where their own call would
+  make them, then arrivals are added, and only then are cores filled, once
+  for the whole tick.  A tick with k events therefore costs one pass of
+  dispatch instead of k, under one acquisition of the combiner.
+
+  A core left free by the tick goes to the best waiting job by the policy,
+  whether that job was already waiting or arrived in the same tick.  Between
+  jobs the policy ranks equal, the earlier arrival wins, so a job that was
+  already waiting goes before one arriving in the tick.  Free cores are
+  filled lowest id first.  The jobs that run match those of the per-event
+  calls whenever no arrival outranks a job that was waiting, though a job
+  may land on a different core.  Under PER_CORE_QUEUES events are still
+  applied one at a time, since there is no shared dispatch to save.
+
+  Safe to call from several threads at once, together with the other event
+  calls.
+
+  @param s the scheduler
+  @param time the current time of the simulator
+  @param arrivals the jobs that arrived, num_arrivals of them
+  @param completions the jobs that finished and the cores they ran on,
+  		     num_completions of them
+  @param expirations the cores whose quantum expired, num_expirations of them
+  @param assignment filled in with the job number that should run on each
+  		    core during the next time unit, or -1 for an idle core.
+  		    Must have room for as many entries as there are cores.
+*/
+void scheduler_tick_r(scheduler_t *s, int time,
+                      const arrival_t *arrivals, int num_arrivals,
+                      const completion_t *completions, int num_completions,
+                      const int *expirations, int num_expirations,
+                      int *assignment){
+
+	// Events already pushed by other threads go first
+	pthread_mutex_lock(&s->combiner);
+	apply_pending(s);
+	time = clamp_time(s, time);
+	apply_tick(s, time, arrivals, num_arrivals, completions, num_completions,
+	           expirations, num_expirations, assignment);
+	pthread_mutex_unlock(&s->combiner);
 }
 
 
@@ -1144,25 +2631,12 @@ int scheduler_quantum_expired(int core_id, int time){
   Assumptions:
     - This function will only be called after all scheduling is complete (all
       jobs that have arrived will have finished and no new jobs will arrive).
+  @param s the scheduler
   @return the average waiting time of all jobs scheduled.
  */
-float scheduler_average_waiting_time(){
-	job_t * current_job;
-	int sum = 0;
-	for(int i = 0; i<priqueue_size(ready_q); ++i){
-		current_job = (job_t *)priqueue_at(ready_q, i);
-		int total, waiting;
-		total = current_job->value[5] - current_job->value[1];
-		waiting = total - current_job->value[2];
-
-		if(DEBUG){
-			printf("Job %d waited %d time units\n", current_job->value[0], waiting);
-		}
-		
-		// waiting time is total time less running time
-		sum += waiting;
-	}
-	return (1.0 * sum)/priqueue_size(ready_q);
+float scheduler_average_waiting_time_r(scheduler_t *s){
+	// waiting time is total time less running time
+	return (1.0 * s->total_waiting)/s->completed;
 }
 
 
@@ -1176,22 +2650,12 @@ float scheduler_average_waiting_time(){
   Assumptions:
     - This function will only be called after all scheduling is complete (all
       jobs that have arrived will have finished and no new jobs will arrive).
+  @param s the scheduler
   @return the average turnaround time of all jobs scheduled.
  */
-float scheduler_average_turnaround_time(){
-	int time = 0;
-	job_t *current_job;
-	for(int i = 0; i<priqueue_size(ready_q); ++i){
-		current_job = (job_t*)priqueue_at(ready_q, i);
-		
-		if(DEBUG){
-			printf("Job %d took a total of %d time units\n", current_job->value[0], current_job->value[5]-current_job->value[1]);
-		}
-				
-		// Add in total time (end-start)
-		time += (current_job->value[5] - current_job->value[1]);
-	}
-	return (1.0 * time)/priqueue_size(ready_q);
+float scheduler_average_turnaround_time_r(scheduler_t *s){
+	// Total time (end-start) of every finished job
+	return (1.0 * s->total_turnaround)/s->completed;
 }
 
 
@@ -1203,40 +2667,55 @@ float scheduler_average_turnaround_time(){
   Assumptions:
     - This function will only be called after all scheduling is complete (all
       jobs that have arrived will have finished and no new jobs will arrive).
+  @param s the scheduler
   @return the average response time of all jobs scheduled.
  */
-float scheduler_average_response_time(){
-	int time = 0;
-	job_t *current_job;
-	for(int i = 0; i<priqueue_size(ready_q); ++i){
-		current_job = (job_t*)priqueue_at(ready_q, i);
-		
-		if(DEBUG){
-			printf("Job %d had latency of %d time units\n", current_job->value[0], current_job->value[7]);
-		}
-		
-		time += current_job->value[7];
-	}
-	return (1.0 * time)/priqueue_size(ready_q);
+float scheduler_average_response_time_r(scheduler_t *s){
+	return (1.0 * s->total_response)/s->completed;
 }
 
 
 /**
-  Free any memory associated with your scheduler.
+  Free any memory associated with a scheduler.
  
   Assumptions:
-    - This function will be the last function called in your library.
+    - This function will be the last function called on the scheduler.
+
+  @param s the scheduler, invalid afterwards
 */
-void scheduler_clean_up(){
-	job_t * curr;
-	while(0 < priqueue_size(ready_q)){
-		curr = (job_t*)priqueue_poll(ready_q);	
-		free(curr->value);
+void scheduler_destroy(scheduler_t *s){
+
+	// Every job, finished or not, lives in a job slab and goes with it
+	job_slab_t *slab = s->job_slabs;
+	job_slab_t *next;
+	while(NULL != slab){
+		next = slab->next;
+		free(slab);
+		slab = next;
+	}
+
+	if(NULL != s->runnable_q){
+		runnableq_destroy(s->runnable_q);
+		free(s->runnable_q);
 	}
-	curr = NULL;
-	priqueue_destroy(ready_q);
-	free(ready_q);
-	free(active_core);
+	cfsq_destroy(&s->cfs_q);
+	if(NULL != s->waiting_q){
+		bucketq_destroy(s->waiting_q);
+		free(s->waiting_q);
+	}
+	if(NULL != s->run_queues){
+		for(int i = 0; i < s->num_cores; ++i){
+			free(s->run_queues[i].heap);
+		}
+		free(s->run_queues);
+	}
+	free(s->active_core);
+	free(s->idle_cores);
+	free(s->running);
+	free(s->job_index);
+	free(s->stats);
+	pthread_mutex_destroy(&s->combiner);
+	free(s);
 }
 
 
@@ -1262,16 +2741,77 @@ void scheduler_clean_up(){
   is there, you are going to have a bad time.  I will seriously punch the original
   authors of this code in the face if I ever meet them.  I shouldn't have to go
   through their code to look for intentionally inserted errors.
- */
 
-void scheduler_show_queue(priqueue_t* q){
+  @param s the scheduler
+ */
+void scheduler_show_queue_r(scheduler_t *s){
 	if(DEBUG){
 		printf("\n");
-		for(int i=0; i<priqueue_size(ready_q); ++i){
-			job_t *daJob = (job_t*)priqueue_at(ready_q, i);
-			printf("\tJob %d:\tArrived:\t%d\tBurst:\t\t%d\tPriority:\t%d\tCore:\t%d\tRunning:\t%d\tComplete:\t%d\n", daJob->value[0], daJob->value[1], daJob->value[2], daJob->value[3], daJob->core, (daJob->core>=0)?1:0, daJob->finished);
-			printf("\t       \tLast active:\t%d\tRuntime:\t%d\n", daJob->value[6], daJob->value[4]);
+		for(int i = 0; i < (1 << s->job_index_bits); ++i){
+			job_t *daJob = s->job_index[i];
+			if(NULL == daJob){
+				continue;
+			}
+			job_stats_t *stats = &s->stats[daJob->slot];
+			printf("\tJob %d:\tArrived:\t%d\tBurst:\t\t%d\tPriority:\t%d\tCore:\t%d\tRunning:\t%d\n", daJob->number, stats->arrival, stats->burst, daJob->priority, daJob->core, (daJob->core>=0)?1:0);
+			printf("\t       \tLast active:\t%d\tRemaining:\t%d\n", daJob->last_active, daJob->remaining);
 		}
 	}
 }
 
+
+/*
+ * The original, context-free API.  It drives a default scheduler created by
+ * scheduler_start_up and released by scheduler_clean_up, so only one such
+ * simulation can run per process.
+ */
+static scheduler_t *default_scheduler;
+
+void scheduler_start_up(int cores, scheme_t scheme){
+	default_scheduler = scheduler_create(cores, scheme);
+}
+
+void scheduler_start_up_queues(int cores, scheme_t scheme, queue_mode_t queues){
+	default_scheduler = scheduler_create_queues(cores, scheme, queues);
+}
+
+int scheduler_new_job(int job_number, int time, int running_time, int priority){
+	return scheduler_new_job_r(default_scheduler, job_number, time, running_time, priority);
+}
+
+int scheduler_job_finished(int core_id, int job_number, int time){
+	return scheduler_job_finished_r(default_scheduler, core_id, job_number, time);
+}
+
+int scheduler_quantum_expired(int core_id, int time){
+	return scheduler_quantum_expired_r(default_scheduler, core_id, time);
+}
+
+void scheduler_tick(int time, const arrival_t *arrivals, int num_arrivals,
+                    const completion_t *completions, int num_completions,
+                    const int *expirations, int num_expirations, int *assignment){
+	scheduler_tick_r(default_scheduler, time, arrivals, num_arrivals, completions, num_completions,
+	                 expirations, num_expirations, assignment);
+}
+
+float scheduler_average_turnaround_time(){
+	return scheduler_average_turnaround_time_r(default_scheduler);
+}
+
+float scheduler_average_waiting_time(){
+	return scheduler_average_waiting_time_r(default_scheduler);
+}
+
+float scheduler_average_response_time(){
+	return scheduler_average_response_time_r(default_scheduler);
+}
+
+void scheduler_clean_up(){
+	scheduler_destroy(default_scheduler);
+	default_scheduler = NULL;
+}
+
+void scheduler_show_queue(){
+	scheduler_show_queue_r(default_scheduler);
+}
+
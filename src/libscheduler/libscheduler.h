@@ -5,14 +5,93 @@
 #define LIBSCHEDULER_H_
 
 /**
-  Constants which represent the different scheduling algorithms
+  Constants which represent the different scheduling algorithms.  MLFQ is a
+  multilevel feedback queue: jobs arrive on the most important level, run
+  round robin within a level, and drop one level each time they use up its
+  quantum.  Quanta double from one level to the next, counted in calls to
+  scheduler_quantum_expired.  Every job is periodically boosted back to the
+  top.  CFS runs the job with the least virtual runtime, the time it has run
+  scaled down by a weight that grows as its priority value falls.  Each
+  runnable job gets a slice of a fixed target latency, also counted in
+  quanta.  MLFQ and CFS always queue jobs globally, whatever the
+  queue_mode_t.
 */
-typedef enum {FCFS = 0, SJF, PSJF, PRI, PPRI, RR} scheme_t;
+typedef enum {FCFS = 0, SJF, PSJF, PRI, PPRI, RR, MLFQ, CFS} scheme_t;
 
+/**
+  How jobs waiting for a core are queued: in one queue shared by every core,
+  or in a run queue per core with work stealing
+*/
+typedef enum {GLOBAL_QUEUE = 0, PER_CORE_QUEUES} queue_mode_t;
+
+/**
+  A job arriving in scheduler_tick, with the arguments of scheduler_new_job
+*/
+typedef struct _arrival_t{
+	int job_number;
+	int running_time;
+	int priority;
+} arrival_t;
+
+/**
+  A job finishing in scheduler_tick, with the arguments of
+  scheduler_job_finished
+*/
+typedef struct _completion_t{
+	int core_id;
+	int job_number;
+} completion_t;
+
+/*
+  scheduler_tick delivers every finish, quantum expiration and arrival of one
+  time unit in one call.  Finished jobs are retired, expired jobs give up
+  their core as their own calls would make them, arrivals are added, and
+  only then are free cores filled, once for the whole tick, lowest id first.
+  A core freed in the tick goes to the best waiting job by the policy,
+  including jobs arriving in the same tick.  On a tie the earlier arrival
+  wins, so a job that was already waiting goes before one arriving in the
+  tick.  Under PER_CORE_QUEUES the events are applied one at a time.
+*/
+
+/**
+  One scheduler instance, created by scheduler_create and released by
+  scheduler_destroy.  scheduler_new_job_r, scheduler_job_finished_r and
+  scheduler_quantum_expired_r may be called on it from several threads at
+  once.  Events are expected in time order.  One whose time is earlier than
+  that of an event already applied is applied at that later time.
+*/
+typedef struct _scheduler_t scheduler_t;
+
+scheduler_t *scheduler_create          (int cores, scheme_t scheme);
+scheduler_t *scheduler_create_queues   (int cores, scheme_t scheme, queue_mode_t queues);
+int   scheduler_new_job_r              (scheduler_t *s, int job_number, int time, int running_time, int priority);
+int   scheduler_job_finished_r         (scheduler_t *s, int core_id, int job_number, int time);
+int   scheduler_quantum_expired_r      (scheduler_t *s, int core_id, int time);
+void  scheduler_tick_r                 (scheduler_t *s, int time,
+                                        const arrival_t *arrivals, int num_arrivals,
+                                        const completion_t *completions, int num_completions,
+                                        const int *expirations, int num_expirations,
+                                        int *assignment);
+float scheduler_average_turnaround_time_r(scheduler_t *s);
+float scheduler_average_waiting_time_r (scheduler_t *s);
+float scheduler_average_response_time_r(scheduler_t *s);
+void  scheduler_destroy                (scheduler_t *s);
+
+void  scheduler_show_queue_r           (scheduler_t *s);
+
+/*
+  The same API on a single default scheduler, set up by scheduler_start_up
+*/
 void  scheduler_start_up               (int cores, scheme_t scheme);
+void  scheduler_start_up_queues        (int cores, scheme_t scheme, queue_mode_t queues);
 int   scheduler_new_job                (int job_number, int time, int running_time, int priority);
 int   scheduler_job_finished           (int core_id, int job_number, int time);
 int   scheduler_quantum_expired        (int core_id, int time);
+void  scheduler_tick                   (int time,
+                                        const arrival_t *arrivals, int num_arrivals,
+                                        const completion_t *completions, int num_completions,
+                                        const int *expirations, int num_expirations,
+                                        int *assignment);
 float scheduler_average_turnaround_time();
 float scheduler_average_waiting_time   ();
 float scheduler_average_response_time  ();
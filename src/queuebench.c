@@ -0,0 +1,404 @@
+/** @file queuebench.c
+ *
+ *  Microbenchmarks for the queue implementations.
+ *
+ *  ./queuebench [-n max] [-t seconds] [priqueue] [typed] [bucketq] [cpriqueue]
+ *
+ *  Every queue is run for sizes 10, 100, ... up to max (10M by default) and
+ *  four key patterns: random, sorted, reverse and all equal.  Each operation
+ *  is reported in ns/op and allocations/op.  Allocations are counted by
+ *  wrapping malloc, calloc and realloc at link time (see the Makefile).
+ *
+ *  The priqueue backend is chosen when building, so the Makefile builds this
+ *  file twice, as queuebench-list and queuebench-heap.
+ *
+ *  Operations, where the queue supports them:
+ *    offer   n offers into an empty queue
+ *    iter    one cursor pass over the n elements, per element
+ *    at      priqueue_at on random indices
+ *    remove  removal of random elements (priqueue_remove, or by handle)
+ *    poll    polling the remaining elements until the queue is empty
+ *
+ *  Sizes at which a single run is predicted to take longer than the time
+ *  limit (-t, LIMIT_MS by default), judging by how its cost grew over the
+ *  last size, are skipped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libpriqueue/libpriqueue.h"
+#include "libpriqueue/libpriqueue_typed.h"
+#include "libpriqueue/libbucketq.h"
+#include "libpriqueue/libcpriqueue.h"
+
+#ifdef PRIQUEUE_HEAP
+#define PRIQUEUE_NAME "heap"
+#else
+#define PRIQUEUE_NAME "list"
+#endif
+
+#define MAX_N 10000000
+#define LIMIT_MS 60000.0
+
+// Small runs are repeated up to this many operations or milliseconds
+#define MIN_OPS 1000000
+#define MIN_MS 200.0
+
+// Number of random at and remove calls per run, at most half the queue so
+// that poll has something left, and fewer on big queues where each call
+// may walk all of it
+#define SAMPLES 100
+#define SAMPLE_WORK 10000000L
+
+#define BUCKETS 1024
+
+enum { OFFER, ITER, AT, REMOVE, POLL, NUM_OPS };
+const char *op_names[NUM_OPS] = { "offer", "iter", "at", "remove", "poll" };
+
+enum { RANDOM, SORTED, REVERSE, EQUAL, NUM_PATTERNS };
+const char *pattern_names[NUM_PATTERNS] = { "random", "sorted", "reverse", "equal" };
+
+
+/* Allocation counting, see BENCHFLAGS in the Makefile */
+
+unsigned long allocs = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+	allocs++;
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t n, size_t size)
+{
+	allocs++;
+	return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+	allocs++;
+	return __real_realloc(ptr, size);
+}
+
+
+double now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int compare1(const void * a, const void * b)
+{
+	return ( *(int*)a - *(int*)b );
+}
+
+static inline int int_key(const int *v){ return *v; }
+static inline int int_cmp(const int *a, const int *b){ return *a - *b; }
+
+PRIQUEUE_DEFINE(intq, int, int, int_key, int_cmp)
+
+
+/* Results of one run, summed over its repetitions */
+typedef struct _result_t
+{
+	double ns[NUM_OPS];
+	unsigned long allocs[NUM_OPS];
+	unsigned long ops[NUM_OPS];
+} result_t;
+
+int *keys;
+void **ptrs;
+int *picks;
+
+int sample_count(int n)
+{
+	int samples = (n / 2 < SAMPLES) ? n / 2 : SAMPLES;
+	if (samples > SAMPLE_WORK / n)
+		samples = (int)(SAMPLE_WORK / n);
+	return (0 < samples) ? samples : 1;
+}
+
+void fill_keys(int pattern, int n)
+{
+	for (int i = 0; i < n; i++)
+	{
+		switch (pattern)
+		{
+			case RANDOM:  keys[i] = rand() % n; break;
+			case SORTED:  keys[i] = i; break;
+			case REVERSE: keys[i] = n - i; break;
+			default:      keys[i] = 0; break;
+		}
+		ptrs[i] = &keys[i];
+	}
+
+	// Distinct positions for at and remove
+	int samples = sample_count(n);
+	for (int i = 0; i < samples; i++)
+		picks[i] = (int)((long)i * n / samples + rand() % (n / samples));
+}
+
+#define TIME_OP(r, op, count, body)				\
+	do {							\
+		unsigned long a0 = allocs;			\
+		double t0 = now_ns();				\
+		body;						\
+		(r)->ns[op] += now_ns() - t0;			\
+		(r)->allocs[op] += allocs - a0;			\
+		(r)->ops[op] += (count);			\
+	} while (0)
+
+
+void run_priqueue(result_t *r, int n, int reps)
+{
+	int samples = sample_count(n);
+	priqueue_t q;
+	priqueue_init(&q, compare1);
+
+	for (int rep = 0; rep < reps; rep++)
+	{
+		TIME_OP(r, OFFER, n,
+			for (int i = 0; i < n; i++)
+				priqueue_offer(&q, ptrs[i]));
+
+		volatile long sum = 0;
+		priqueue_iter_t it;
+		void *v;
+		TIME_OP(r, ITER, n,
+			priqueue_iter_init(&it, &q);
+			while (NULL != (v = priqueue_iter_next(&it)))
+				sum += *(int *)v);
+
+		TIME_OP(r, AT, samples,
+			for (int i = 0; i < samples; i++)
+				sum += *(int *)priqueue_at(&q, picks[i]));
+
+		// priqueue_remove matches by pointer and scans the whole queue
+		TIME_OP(r, REMOVE, samples,
+			for (int i = 0; i < samples; i++)
+				priqueue_remove(&q, ptrs[picks[i]]));
+
+		int left = priqueue_size(&q);
+		TIME_OP(r, POLL, left,
+			while (NULL != priqueue_poll(&q))
+				;);
+	}
+
+	priqueue_destroy(&q);
+}
+
+void run_typed(result_t *r, int n, int reps)
+{
+	intq_t q;
+	intq_init(&q, 0);
+
+	for (int rep = 0; rep < reps; rep++)
+	{
+		TIME_OP(r, OFFER, n,
+			for (int i = 0; i < n; i++)
+				intq_offer(&q, &keys[i]));
+
+		TIME_OP(r, POLL, n,
+			while (NULL != intq_poll(&q))
+				;);
+	}
+
+	intq_destroy(&q);
+}
+
+bucket_node_t **handles;
+
+void run_bucketq(result_t *r, int n, int reps)
+{
+	int samples = sample_count(n);
+	bucketq_t bq;
+	bucketq_init(&bq, BUCKETS);
+
+	for (int rep = 0; rep < reps; rep++)
+	{
+		TIME_OP(r, OFFER, n,
+			for (int i = 0; i < n; i++)
+				handles[i] = bucketq_offer(&bq, ptrs[i], (int)((long)keys[i] * BUCKETS / (n + 1)), i));
+
+		TIME_OP(r, REMOVE, samples,
+			for (int i = 0; i < samples; i++)
+				bucketq_remove(&bq, handles[picks[i]]));
+
+		int left = bucketq_size(&bq);
+		TIME_OP(r, POLL, left,
+			while (NULL != bucketq_poll(&bq))
+				;);
+	}
+
+	bucketq_destroy(&bq);
+}
+
+void run_cpriqueue(result_t *r, int n, int reps)
+{
+	cpriqueue_t q;
+	cpriqueue_init(&q, compare1, 2);
+
+	for (int rep = 0; rep < reps; rep++)
+	{
+		TIME_OP(r, OFFER, n,
+			for (int i = 0; i < n; i++)
+				cpriqueue_offer(&q, ptrs[i]));
+
+		TIME_OP(r, POLL, n,
+			while (NULL != cpriqueue_poll(&q))
+				;);
+	}
+
+	cpriqueue_destroy(&q);
+}
+
+
+typedef struct _backend_t
+{
+	const char *name;
+	void (*run)(result_t *r, int n, int reps);
+} backend_t;
+
+backend_t backends[] = {
+	{ "priqueue", run_priqueue },
+	{ "typed", run_typed },
+	{ "bucketq", run_bucketq },
+	{ "cpriqueue", run_cpriqueue },
+};
+
+#define NUM_BACKENDS ((int)(sizeof(backends) / sizeof(backends[0])))
+
+
+void bench_backend(backend_t *b, int max_n, double limit_ms)
+{
+	const char *name = (b->run == run_priqueue) ? "priqueue (" PRIQUEUE_NAME ")" : b->name;
+
+	printf("\n%s\n", name);
+	printf("%-8s %9s", "keys", "n");
+	for (int op = 0; op < NUM_OPS; op++)
+		printf("  %10s %-9s", op_names[op], "ns/op al/op");
+	printf("\n");
+
+	for (int pattern = 0; pattern < NUM_PATTERNS; pattern++)
+	{
+		double predicted = 0;
+		double last_per_op = 0;
+		for (int n = 10; n <= max_n; n *= 10)
+		{
+			if (predicted > limit_ms)
+			{
+				printf("%-8s %9d  skipped, predicted %.0f s\n", pattern_names[pattern], n, predicted / 1000);
+				break;
+			}
+
+			srand(678);
+			fill_keys(pattern, n);
+
+			result_t r;
+			memset(&r, 0, sizeof(r));
+			double start = now_ns();
+			b->run(&r, n, 1);
+			double ms = (now_ns() - start) / 1e6;
+
+			// Repeat small runs on the same queue until they add up to
+			// MIN_OPS operations or MIN_MS
+			int reps = MIN_OPS / n;
+			if (0 < ms && reps > MIN_MS / ms)
+				reps = (int)(MIN_MS / ms);
+			if (1 < reps)
+			{
+				start = now_ns();
+				b->run(&r, n, reps);
+				ms = (now_ns() - start) / 1e6 / reps;
+			}
+
+			// Expect the cost per element to keep growing the way it
+			// did over the last step.  Nothing here is worse than
+			// quadratic, so more than 10x per step is noise.
+			double per_op = ms / n;
+			double growth = (0 < last_per_op) ? per_op / last_per_op : 1;
+			if (1 > growth)
+				growth = 1;
+			if (10 < growth)
+				growth = 10;
+			predicted = ms * 10 * growth;
+			last_per_op = per_op;
+
+			printf("%-8s %9d", pattern_names[pattern], n);
+			for (int op = 0; op < NUM_OPS; op++)
+			{
+				if (0 == r.ops[op])
+					printf("  %10s %-9s", "-", "");
+				else
+					printf("  %10.1f %-9.3f", r.ns[op] / r.ops[op], (double)r.allocs[op] / r.ops[op]);
+			}
+			printf("\n");
+			fflush(stdout);
+		}
+	}
+}
+
+int main(int argc, char **argv)
+{
+	int max_n = MAX_N;
+	double limit_ms = LIMIT_MS;
+	int chosen[NUM_BACKENDS] = { 0 };
+	int any = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+		{
+			max_n = atoi(argv[++i]);
+			continue;
+		}
+		if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+		{
+			limit_ms = atof(argv[++i]) * 1000;
+			continue;
+		}
+		int found = 0;
+		for (int b = 0; b < NUM_BACKENDS; b++)
+		{
+			if (strcmp(argv[i], backends[b].name) == 0)
+			{
+				chosen[b] = found = any = 1;
+			}
+		}
+		if (!found)
+		{
+			fprintf(stderr, "usage: %s [-n max] [-t seconds] [priqueue] [typed] [bucketq] [cpriqueue]\n", argv[0]);
+			return 1;
+		}
+	}
+
+	keys = malloc(max_n * sizeof(int));
+	ptrs = malloc(max_n * sizeof(void *));
+	handles = malloc(max_n * sizeof(bucket_node_t *));
+	picks = malloc(SAMPLES * sizeof(int));
+	if (NULL == keys || NULL == ptrs || NULL == handles || NULL == picks)
+	{
+		fprintf(stderr, "Out of memory.\n");
+		exit(2);
+	}
+
+	for (int b = 0; b < NUM_BACKENDS; b++)
+		if (!any || chosen[b])
+			bench_backend(&backends[b], max_n, limit_ms);
+
+	free(picks);
+	free(handles);
+	free(ptrs);
+	free(keys);
+
+	return 0;
+}
@@ -3,8 +3,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include "libpriqueue/libpriqueue.h"
+#include "libpriqueue/libbucketq.h"
+#include "libpriqueue/libpriqueue_typed.h"
+#include "libscheduler/libscheduler.h"
 
 int compare1(const void * a, const void * b)
 {
@@ -20,13 +25,108 @@ int compare3(const void *a, const void *b){
 	return -1;	
 }
 
-int main()
+int compare4(const void *a, const void *b)
 {
-	priqueue_t q, q2, q3;
+	return ( *(int*)a / 10 - *(int*)b / 10 );
+}
+
+static inline int tens_key(const int *a)
+{
+	return *a / 10;
+}
+
+static inline int int_cmp(const int *a, const int *b)
+{
+	return *a - *b;
+}
+
+PRIQUEUE_DEFINE(tensq, int, int, tens_key, int_cmp)
+
+double now_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+/*
+ * Times n calls to priqueue_offer against one priqueue_offer_many on the same
+ * random keys, then checks that both queues poll in the same order.
+ */
+int bench_offer_many(int n)
+{
+	int *keys = malloc(n * sizeof(int));
+	void **ptrs = malloc(n * sizeof(void *));
+	int i;
+
+	srand(678);
+	for (i = 0; i < n; i++)
+	{
+		keys[i] = rand() % (n / 4 + 1);
+		ptrs[i] = &keys[i];
+	}
+
+	priqueue_t single, bulk;
+	priqueue_init(&single, compare1);
+	priqueue_init(&bulk, compare1);
+
+#ifdef PRIQUEUE_HEAP
+	int run_single = 1;
+#else
+	// n sorted list inserts are quadratic, so do not wait on them at scale
+	int run_single = (n <= 20000);
+#endif
+
+	double single_ms = 0;
+	if (run_single)
+	{
+		double start = now_ms();
+		for (i = 0; i < n; i++)
+			priqueue_offer(&single, ptrs[i]);
+		single_ms = now_ms() - start;
+	}
+
+	double start = now_ms();
+	priqueue_offer_many(&bulk, ptrs, n);
+	double bulk_ms = now_ms() - start;
+
+	printf("Bulk load of %d elements:\n", n);
+	if (run_single)
+		printf("  priqueue_offer x %d: %10.2f ms\n", n, single_ms);
+	else
+		printf("  priqueue_offer x %d: skipped (quadratic on the list backend)\n", n);
+	printf("  priqueue_offer_many: %10.2f ms\n", bulk_ms);
+	if (run_single && bulk_ms > 0)
+		printf("  speedup:             %10.2fx\n", single_ms / bulk_ms);
+
+	int mismatches = 0;
+	if (run_single)
+	{
+		for (i = 0; i < n; i++)
+			if (priqueue_poll(&single) != priqueue_poll(&bulk))
+				mismatches++;
+		printf("  poll order mismatches: %d (expected 0)\n", mismatches);
+	}
+
+	priqueue_destroy(&single);
+	priqueue_destroy(&bulk);
+	free(ptrs);
+	free(keys);
+
+	return (mismatches == 0) ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 1 && strcmp(argv[1], "bench") == 0)
+		return bench_offer_many((argc > 2) ? atoi(argv[2]) : 1000000);
+
+	priqueue_t q, q2, q3, q4;
 
 	priqueue_init(&q, compare1);
 	priqueue_init(&q2, compare2);
 	priqueue_init(&q3, compare3);
+	priqueue_init_capacity(&q4, compare4, 8);
 
 	/* Pupulate some data... */
 	int *values = malloc(100 * sizeof(int));
@@ -131,6 +231,229 @@ int main()
 
 	printf("\n");
 
+
+	/* Ties must come back out in the order they went in */
+	priqueue_offer(&q3, &values[3]);
+	priqueue_offer(&q3, &values[1]);
+	priqueue_offer(&q3, &values[2]);
+
+	priqueue_offer(&q4, &values[25]);
+	priqueue_offer(&q4, &values[11]);
+	priqueue_offer(&q4, &values[21]);
+	priqueue_offer(&q4, &values[19]);
+	priqueue_offer(&q4, &values[15]);
+	priqueue_offer(&q4, &values[28]);
+
+	printf("Elements in FIFO queue (expected 3 1 2): ");
+	while (priqueue_size(&q3) > 0)
+		printf("%d ", *((int *)priqueue_poll(&q3)) );
+	printf("\n");
+
+	printf("Elements in tied queue (expected 11 19 15 25 21 28): ");
+	while (priqueue_size(&q4) > 0)
+		printf("%d ", *((int *)priqueue_poll(&q4)) );
+	printf("\n");
+
+	printf("\n");
+
+
+	/* Handles let an element be moved or removed after its key changes */
+	int keys[4] = { 40, 10, 30, 20 };
+	node_t *handles[4];
+	for (i = 0; i < 4; i++)
+		handles[i] = priqueue_offer_handle(&q, &keys[i]);
+
+	keys[0] = 0;
+	priqueue_update(&q, handles[0]);
+	keys[1] = 35;
+	priqueue_update(&q, handles[1]);
+	int *removed = (int *)priqueue_remove_handle(&q, handles[2]);
+	printf("Removed by handle: %d (expected 30)\n", *removed);
+
+	node_t *first = priqueue_offer_handle(&q4, &values[25]);
+	node_t *second = priqueue_offer_handle(&q4, &values[21]);
+	printf("Precedes: %d %d %d (expected 1 1 0)\n",
+		priqueue_precedes(&q, handles[3], handles[1]),
+		priqueue_precedes(&q4, first, second),
+		priqueue_precedes(&q4, second, first));
+	priqueue_remove_handle(&q4, first);
+	priqueue_remove_handle(&q4, second);
+
+	printf("Elements after updates (expected 0 1 1 1 1 5 9 9 9 9 20 35): ");
+	for (i = 0; i < priqueue_size(&q); i++)
+		printf("%d ", *((int *)priqueue_at(&q, i)) );
+	printf("\n");
+
+	priqueue_iter_t it;
+	int *curr;
+
+	printf("Elements by cursor (expected 0 1 1 1 1 5 9 9 9 9 20 35): ");
+	priqueue_iter_init(&it, &q);
+	while ((curr = (int *)priqueue_iter_next(&it)) != NULL)
+		printf("%d ", *curr);
+	printf("\n");
+
+	printf("Elements by reverse cursor (expected 35 20 9 9 9 9 5 1 1 1 1 0): ");
+	priqueue_iter_init_reverse(&it, &q);
+	while ((curr = (int *)priqueue_iter_next(&it)) != NULL)
+		printf("%d ", *curr);
+	printf("\n");
+
+	printf("\n");
+
+
+	/* A bulk load must land exactly where separate offers would */
+	void *batch[5] = { &values[21], &values[19], &values[15], &values[28], &values[12] };
+	priqueue_offer(&q4, &values[25]);
+	priqueue_offer(&q4, &values[11]);
+	priqueue_offer_many(&q4, batch, 5);
+
+	printf("Elements after bulk load (expected 11 19 15 12 25 21 28): ");
+	while (priqueue_size(&q4) > 0)
+		printf("%d ", *((int *)priqueue_poll(&q4)) );
+	printf("\n");
+
+	printf("\n");
+
+
+	/* Typed queue keyed on the tens digit, ties in FIFO order */
+	tensq_t tq;
+	tensq_init(&tq, 0);
+	tensq_offer(&tq, &values[25]);
+	tensq_offer(&tq, &values[11]);
+	tensq_offer(&tq, &values[21]);
+	tensq_offer(&tq, &values[19]);
+	tensq_offer(&tq, &values[15]);
+	tensq_offer(&tq, &values[28]);
+
+	printf("Elements in typed queue (expected 11 19 15 25 21 28): ");
+	while (tensq_size(&tq) > 0)
+		printf("%d ", *tensq_poll(&tq));
+	printf("\n");
+
+	tensq_destroy(&tq);
+
+
+	/* Bucket queue: lowest key first, then by order within a key */
+	bucketq_t bq;
+	bucketq_init(&bq, 100);
+	bucketq_offer(&bq, &values[70], 70, 0);
+	bucketq_offer(&bq, &values[3], 3, 1);
+	bucket_node_t *bhandle = bucketq_offer(&bq, &values[65], 65, 2);
+	bucketq_offer(&bq, &values[4], 3, 3);
+	bucketq_offer(&bq, &values[2], 3, 0);
+	bucketq_remove(&bq, bhandle);
+
+	printf("Elements in bucket queue (expected 2 3 4 70): ");
+	while (bucketq_size(&bq) > 0)
+		printf("%d ", *((int *)bucketq_poll(&bq)) );
+	printf("\n");
+
+	printf("\n");
+
+	bucketq_destroy(&bq);
+
+
+	/* MLFQ demotion with nothing else waiting keeps the job on its core,
+	   even with a lower core idle */
+	scheduler_t *sched = scheduler_create(2, MLFQ);
+	scheduler_new_job_r(sched, 0, 0, 5, 0);
+	scheduler_new_job_r(sched, 1, 0, 5, 0);
+	scheduler_job_finished_r(sched, 0, 0, 1);
+	printf("Job on core 1 after its quantum: %d (expected 1).\n", scheduler_quantum_expired_r(sched, 1, 1));
+	printf("Core of a new arrival: %d (expected 0).\n", scheduler_new_job_r(sched, 2, 2, 5, 0));
+	scheduler_destroy(sched);
+
+	printf("\n");
+
+
+	/* Per-core run queues under SJF: with both cores busy, arrivals
+	   alternate between the run queues, so core 0 queues jobs 2, 4, 6, 8
+	   and 10 and core 1 jobs 3, 5, 7 and 9.  Once core 1 has run its own,
+	   it steals the tail of core 0's run queue, the longest job, while
+	   core 0 itself takes the shortest. */
+	int bursts[] = { 20, 1, 5, 2, 40, 3, 10, 4, 30 };
+	sched = scheduler_create_queues(2, SJF, PER_CORE_QUEUES);
+	scheduler_new_job_r(sched, 0, 0, 100, 0);
+	scheduler_new_job_r(sched, 1, 0, 100, 0);
+	for (i = 0; i < 9; i++)
+		scheduler_new_job_r(sched, i + 2, 0, bursts[i], 0);
+
+	printf("Jobs core 1 runs (expected 3 5 7 9 6 10): ");
+	int job = 1;
+	for (i = 0; i < 6; i++)
+	{
+		job = scheduler_job_finished_r(sched, 1, job, i + 1);
+		printf("%d ", job);
+	}
+	printf("\n");
+	printf("Job core 0 runs next: %d (expected 4).\n", scheduler_job_finished_r(sched, 0, 0, 7));
+	scheduler_destroy(sched);
+
+	printf("\n");
+
+
+	/* CFS on one core: with two jobs the slice is 12 / 2 = 6 quanta.  Job
+	   0 has priority 0, weight 1024, and gains 6 virtual runtime a slice;
+	   job 1 has priority 5, weight 335, and gains 18.  Job 1 takes the
+	   core after job 0's first slice, loses it after its own, and job 0
+	   keeps it through the tie at 18 until it has run more. */
+	sched = scheduler_create(1, CFS);
+	scheduler_new_job_r(sched, 0, 0, 100, 0);
+	scheduler_new_job_r(sched, 1, 0, 100, 5);
+
+	printf("Jobs at the end of each slice (expected 1 0 0 0 1): ");
+	for (i = 1; i <= 30; i++)
+	{
+		job = scheduler_quantum_expired_r(sched, 0, i);
+		if (i % 6 == 0)
+			printf("%d ", job);
+	}
+	printf("\n");
+	scheduler_destroy(sched);
+
+	/* The slice shrinks as more jobs could run */
+	printf("Quanta before the first switch with 2, 3 and 4 jobs (expected 6 4 3): ");
+	for (int jobs = 2; jobs <= 4; jobs++)
+	{
+		sched = scheduler_create(1, CFS);
+		for (i = 0; i < jobs; i++)
+			scheduler_new_job_r(sched, i, 0, 100, 0);
+		for (i = 1; scheduler_quantum_expired_r(sched, 0, i) == 0; i++)
+			;
+		printf("%d ", i);
+		scheduler_destroy(sched);
+	}
+	printf("\n");
+
+	/* One tick against the same events one call at a time: SJF on two
+	   cores, job 2 waiting when job 1 finishes on core 1 and the longer
+	   job 3 arrives.  Both give core 1 to job 2. */
+	int tick_bursts[] = { 10, 3, 8 };
+	arrival_t arrival = { 3, 20, 0 };
+	completion_t completion = { 1, 1 };
+	int assignment[2], cores[2];
+	scheduler_t *events = scheduler_create(2, SJF);
+	sched = scheduler_create(2, SJF);
+	for (i = 0; i < 3; i++)
+	{
+		scheduler_new_job_r(sched, i, 0, tick_bursts[i], 0);
+		if ((job = scheduler_new_job_r(events, i, 0, tick_bursts[i], 0)) != -1)
+			cores[job] = i;
+	}
+	scheduler_tick_r(sched, 3, &arrival, 1, &completion, 1, NULL, 0, assignment);
+	printf("Jobs on each core after one tick (expected 0 2): %d %d\n", assignment[0], assignment[1]);
+	cores[1] = scheduler_job_finished_r(events, 1, 1, 3);
+	if ((job = scheduler_new_job_r(events, 3, 3, 20, 0)) != -1)
+		cores[job] = 3;
+	printf("Jobs on each core after each event (expected 0 2): %d %d\n", cores[0], cores[1]);
+	scheduler_destroy(events);
+	scheduler_destroy(sched);
+
+	printf("\n");
+
+	priqueue_destroy(&q4);
+	priqueue_destroy(&q3);
 	priqueue_destroy(&q2);
 	priqueue_destroy(&q);
 
@@ -0,0 +1,183 @@
+/** @file schedbench.c
+ *
+ *  Contention benchmark for concurrent event delivery to one scheduler.
+ *
+ *  ./schedbench [-c cores] [-n rounds] [-t max_threads]
+ *
+ *  For 1..max_threads threads, every thread delivers arrivals and, for the
+ *  cores it owns (core % threads == thread), finishes and quantum
+ *  expirations, all to the same RR scheduler.  The threads share n rounds,
+ *  each an arrival (while fewer than JOBS_PER_CORE jobs per core are alive)
+ *  and a call for the next owned core that has a job.  Reported is the
+ *  number of scheduler calls per second over all threads, once with one
+ *  ready queue and once with per-core run queues.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "libscheduler/libscheduler.h"
+
+// Jobs alive at once, per core
+#define JOBS_PER_CORE 4
+
+double now_ms()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+
+scheduler_t *sched;
+int cores;
+int threads;
+
+// Job running on each core as far as the threads know, or -1
+atomic_int *core_job;
+
+// Time handed out to events, and jobs that have arrived and not finished
+atomic_int clock_now;
+atomic_int alive;
+atomic_int next_job;
+
+// Scheduler calls made so far
+atomic_long calls;
+
+typedef struct _bench_arg_t
+{
+	int id;
+	int rounds;
+	unsigned int seed;
+} bench_arg_t;
+
+/*
+ * Records the job a call put on a core.  A finish or expiration only
+ * replaces the job it was delivered for: if an arrival has been put on the
+ * core in the meantime, that arrival's record stands.
+ */
+void set_core_job(int core, int old_job, int new_job)
+{
+	atomic_compare_exchange_strong(&core_job[core], &old_job, new_job);
+}
+
+void *worker(void *arg)
+{
+	bench_arg_t *a = arg;
+	long done = 0;
+	int core = a->id;
+
+	for (int round = 0; round < a->rounds; round++)
+	{
+		// Keep the queue at a steady depth
+		if (atomic_load(&alive) < JOBS_PER_CORE * cores)
+		{
+			atomic_fetch_add(&alive, 1);
+			int job = atomic_fetch_add(&next_job, 1);
+			int c = scheduler_new_job_r(sched, job, atomic_fetch_add(&clock_now, 1), 1000, rand_r(&a->seed) % 8);
+			if (c >= 0)
+				atomic_store(&core_job[c], job);
+			done++;
+		}
+
+		// Then serve the next core this thread owns
+		int job = atomic_load(&core_job[core]);
+		if (job >= 0)
+		{
+			int time = atomic_fetch_add(&clock_now, 1);
+			int next;
+			if (0 == rand_r(&a->seed) % 4)
+			{
+				next = scheduler_job_finished_r(sched, core, job, time);
+				atomic_fetch_sub(&alive, 1);
+			}
+			else
+				next = scheduler_quantum_expired_r(sched, core, time);
+			set_core_job(core, job, next);
+			done++;
+		}
+
+		core += threads;
+		if (core >= cores)
+			core = a->id;
+	}
+	atomic_fetch_add(&calls, done);
+	return NULL;
+}
+
+double run_bench(queue_mode_t queues, int n)
+{
+	pthread_t tids[threads];
+	bench_arg_t args[threads];
+
+	sched = scheduler_create_queues(cores, RR, queues);
+	for (int i = 0; i < cores; i++)
+		atomic_init(&core_job[i], -1);
+	atomic_init(&clock_now, 0);
+	atomic_init(&alive, 0);
+	atomic_init(&next_job, 0);
+	atomic_init(&calls, 0);
+
+	double start = now_ms();
+	for (int i = 0; i < threads; i++)
+	{
+		args[i].id = i;
+		args[i].rounds = n / threads;
+		args[i].seed = i * 7919 + 1;
+		pthread_create(&tids[i], NULL, worker, &args[i]);
+	}
+	for (int i = 0; i < threads; i++)
+		pthread_join(tids[i], NULL);
+	double ms = now_ms() - start;
+
+	scheduler_destroy(sched);
+	return (ms > 0) ? atomic_load(&calls) / ms / 1000.0 : 0;
+}
+
+int main(int argc, char **argv)
+{
+	int n = 1000000;
+	int max_threads = 8;
+	cores = 16;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+			cores = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+			n = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+			max_threads = atoi(argv[++i]);
+		else
+		{
+			fprintf(stderr, "usage: %s [-c cores] [-n rounds] [-t max_threads]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (max_threads > cores)
+		max_threads = cores;
+
+	core_job = malloc(cores * sizeof(atomic_int));
+	if (NULL == core_job)
+	{
+		fprintf(stderr, "Out of memory.\n");
+		exit(2);
+	}
+
+	printf("%d rounds on %d cores under RR, million decisions/s:\n", n, cores);
+	printf("  threads       global      percore\n");
+	for (threads = 1; threads <= max_threads; threads++)
+	{
+		double g = run_bench(GLOBAL_QUEUE, n);
+		double p = run_bench(PER_CORE_QUEUES, n);
+		printf("  %7d %12.2f %12.2f\n", threads, g, p);
+		fflush(stdout);
+	}
+
+	free(core_job);
+	return 0;
+}
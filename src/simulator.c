@@ -20,10 +20,12 @@ typedef struct _simulator_job_list_t
 
 void print_usage(char *program_name)
 {
-	fprintf(stderr, "Usage: %s -c <cores> -s <scheme> <input file>\n", program_name);
+	fprintf(stderr, "Usage: %s -c <cores> -s <scheme> [-q <queues>] [-t] <input file>\n", program_name);
 	fprintf(stderr, "       %s -c 2 -s fcfs examples/proc1.csv\n", program_name);
 	fprintf(stderr, "\n");
-	fprintf(stderr, "Acceptable schemes are: fcfs, sjf, psjf, pri, ppri, rr#\n");
+	fprintf(stderr, "Acceptable schemes are: fcfs, sjf, psjf, pri, ppri, rr#, mlfq[#], cfs[#]\n");
+	fprintf(stderr, "Acceptable queues are: global (default), percore\n");
+	fprintf(stderr, "With -t, the events of each time unit are delivered in one scheduler_tick call\n");
 }
 
 int set_active_job(int job_id, int core_id, simulator_job_list_t *jobs, int active_jobs)
@@ -82,13 +84,14 @@ void print_available_cores(int cores)
 int main(int argc, char **argv)
 {
 	int c;
-	int cores = 0, scheme = -1, quantum = 0;
+	int cores = 0, scheme = -1, quantum = 0, tick = 0;
+	queue_mode_t queues = GLOBAL_QUEUE;
 	char *file_name;
 
 	/*
 	 * Parse command line options.
 	 */
-	while ((c = getopt(argc, argv, "c:s:")) != -1)
+	while ((c = getopt(argc, argv, "c:s:q:t")) != -1)
 	{
 		switch (c)
 		{
@@ -121,6 +124,45 @@ int main(int argc, char **argv)
 						return 1;
 					}
 				}
+				else if (strncasecmp(optarg, "MLFQ", 4) == 0)
+				{
+					scheme = MLFQ;
+					quantum = (optarg[4] == '\0') ? 1 : atoi(optarg + 4);
+
+					if (quantum <= 0)
+					{
+						fprintf(stderr, "Option -s <scheme> requires a positive number for the base quantum of MLFQ, if one is given. (Eg: -s MLFQ2)\n");
+						print_usage(argv[0]);
+						return 1;
+					}
+				}
+				else if (strncasecmp(optarg, "CFS", 3) == 0)
+				{
+					scheme = CFS;
+					quantum = (optarg[3] == '\0') ? 1 : atoi(optarg + 3);
+
+					if (quantum <= 0)
+					{
+						fprintf(stderr, "Option -s <scheme> requires a positive number for the base quantum of CFS, if one is given. (Eg: -s CFS2)\n");
+						print_usage(argv[0]);
+						return 1;
+					}
+				}
+				break;
+
+			case 'q':
+				if (strcasecmp(optarg, "global") == 0) { queues = GLOBAL_QUEUE; }
+				else if (strcasecmp(optarg, "percore") == 0) { queues = PER_CORE_QUEUES; }
+				else
+				{
+					fprintf(stderr, "Option -q <queues> must be global or percore.\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			case 't':
+				tick = 1;
 				break;
 
 			case '?':
@@ -147,6 +189,13 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
+	if ((scheme == MLFQ || scheme == CFS) && queues == PER_CORE_QUEUES)
+	{
+		fprintf(stderr, "Option -q percore is not supported with -s mlfq or -s cfs.\n");
+		print_usage(argv[0]);
+		return 1;
+	}
+
 	if (optind == argc - 1)
 		file_name = argv[optind];
 	else
@@ -224,15 +273,24 @@ int main(int argc, char **argv)
 	else if (scheme == PRI) { printf("Non-preemptive Priority (PRI)"); }
 	else if (scheme == PPRI) { printf("Preemptive Priority (PPRI)"); }
 	else if (scheme == RR) { printf("Round Robin (RR) with a quantum of %d", quantum); }
+	else if (scheme == MLFQ) { printf("Multilevel Feedback Queue (MLFQ) with a base quantum of %d", quantum); }
+	else if (scheme == CFS) { printf("Completely Fair Scheduler (CFS) with a base quantum of %d", quantum); }
+	if (queues == PER_CORE_QUEUES) { printf(" with per-core run queues"); }
+	if (tick) { printf(", one tick per time unit"); }
 	printf(" scheduling...\n\n");
 
-	scheduler_start_up(cores, scheme);
+	scheduler_start_up_queues(cores, scheme, queues);
 
 
 	int time = 0, i, j;
 	int active_jobs = job_id, jobs_alive = 0;
 
 	int *quantum_clock = malloc(cores * sizeof(int));
+	arrival_t *arrivals = malloc(job_id * sizeof(arrival_t));
+	completion_t *completions = malloc(cores * sizeof(completion_t));
+	int *expirations = malloc(cores * sizeof(int));
+	int *assignment = malloc(cores * sizeof(int));
+	int *previous = malloc(cores * sizeof(int));
 	char **core_timing_diagram = malloc(cores * sizeof(char *));
 	int core_timing_diagram_size = 1024;
 
@@ -248,8 +306,11 @@ int main(int argc, char **argv)
 		printf("=== [TIME %d] ===\n", time);
 
 		/*
-		 * 1. Check if any jobs finished in the last time unit.
+		 * 1. Check if any jobs finished in the last time unit.  With -t,
+		 * this and the next two steps only collect the events for the tick.
 		 */
+		int num_completions = 0, num_expirations = 0, num_arrivals = 0;
+
 		for (i = 0; i < active_jobs; i++)
 		{
 			if (jobs[i].run_time == 0)
@@ -257,9 +318,18 @@ int main(int argc, char **argv)
 				// Notify the scheduler has finished
 				int job_id = jobs[i].job_id;
 				int core_id = jobs[i].core_id;
-				int new_job_id = scheduler_job_finished(jobs[i].core_id, jobs[i].job_id, time);
+				int new_job_id = -1;
+
+				if (tick)
+				{
+					completions[num_completions].core_id = core_id;
+					completions[num_completions].job_number = job_id;
+					num_completions++;
+				}
+				else
+					new_job_id = scheduler_job_finished(jobs[i].core_id, jobs[i].job_id, time);
 
-				if (scheme == RR)
+				if (scheme == RR || scheme == MLFQ || scheme == CFS)
 					quantum_clock[jobs[i].core_id] = quantum;
 
 				// Delete the finished jobs, decrease the number of active jobs
@@ -269,6 +339,9 @@ int main(int argc, char **argv)
 				jobs_alive--;
 				i--;
 
+				if (tick)
+					continue;
+
 				// Set the new job
 				if ( new_job_id != -1 && !set_active_job(new_job_id, core_id, jobs, active_jobs) )
 				{
@@ -287,13 +360,13 @@ int main(int argc, char **argv)
 		/*
 		 * Check to see if we finished our last job.  (If we don't check here, we would run an extra time unit that will be totally idle.)
 		 */
-		if (active_jobs == 0)
+		if (active_jobs == 0 && !tick)
 			break;
 
 		/*
 		 * 2. Check of any quantums expired in the last time unit.
 		 */
-		if (scheme == RR)
+		if (scheme == RR || scheme == MLFQ || scheme == CFS)
 		{
 			for (i = 0; i < cores; i++)
 			{
@@ -303,6 +376,13 @@ int main(int argc, char **argv)
 					{
 						if (jobs[j].core_id == i)
 						{
+							if (tick)
+							{
+								expirations[num_expirations++] = i;
+								quantum_clock[i] = quantum;
+								break;
+							}
+
 							// Notify the scheduler the quantum has expired
 							int core_id = jobs[j].core_id;
 							int old_job_id = jobs[j].job_id;
@@ -338,7 +418,17 @@ int main(int argc, char **argv)
 		 */
 		for (i = 0; i < active_jobs; i++)
 		{
-			if (jobs[i].arrival_time == time)
+			if (jobs[i].arrival_time == time && tick)
+			{
+				arrivals[num_arrivals].job_number = jobs[i].job_id;
+				arrivals[num_arrivals].running_time = jobs[i].run_time;
+				arrivals[num_arrivals].priority = jobs[i].priority;
+				num_arrivals++;
+
+				jobs[i].arrived = 1;
+				jobs_alive++;
+			}
+			else if (jobs[i].arrival_time == time)
 			{
 				int new_job_core_id = scheduler_new_job(jobs[i].job_id, time, jobs[i].run_time, jobs[i].priority);
 				jobs[i].arrived = 1;
@@ -358,7 +448,7 @@ int main(int argc, char **argv)
 					// Assign the core to the new job
 					jobs[i].core_id = new_job_core_id;
 
-					if (scheme == RR)
+					if (scheme == RR || scheme == MLFQ || scheme == CFS)
 						quantum_clock[new_job_core_id] = quantum;
 				}
 				else if (new_job_core_id == -1)
@@ -376,6 +466,71 @@ int main(int argc, char **argv)
 			}
 		}
 
+		/*
+		 * With -t, deliver the events collected above in one call, and run
+		 * whatever it assigns to each core.
+		 */
+		if (tick && num_completions + num_expirations + num_arrivals > 0)
+		{
+			for (i = 0; i < cores; i++)
+				previous[i] = -1;
+			for (i = 0; i < active_jobs; i++)
+			{
+				if (jobs[i].core_id != -1)
+					previous[jobs[i].core_id] = jobs[i].job_id;
+				jobs[i].core_id = -1;
+			}
+
+			scheduler_tick(time, arrivals, num_arrivals, completions, num_completions,
+			               expirations, num_expirations, assignment);
+
+			for (i = 0; i < cores; i++)
+			{
+				if ( assignment[i] != -1 && !set_active_job(assignment[i], i, jobs, active_jobs) )
+				{
+					printf("The scheduler_tick() selected an invalid job (job_id == %d) for core %d.\n", assignment[i], i);
+					print_available_jobs(jobs, active_jobs);
+					return 3;
+				}
+
+				if ((scheme == RR || scheme == MLFQ || scheme == CFS) && assignment[i] != previous[i])
+					quantum_clock[i] = quantum;
+			}
+
+			for (i = 0; i < num_completions; i++)
+			{
+				printf("Job %d, running on core %d, finished. Core %d is now running job %d.\n",
+						completions[i].job_number, completions[i].core_id, completions[i].core_id, assignment[completions[i].core_id]);
+				printf("  Queue: "); scheduler_show_queue(); printf("\n\n");
+			}
+
+			for (i = 0; i < num_expirations; i++)
+			{
+				printf("Job %d, running on core %d, had its quantum expire. Core %d is now running job %d.\n",
+						previous[expirations[i]], expirations[i], expirations[i], assignment[expirations[i]]);
+				printf("  Queue: "); scheduler_show_queue(); printf("\n\n");
+			}
+
+			for (i = 0; i < num_arrivals; i++)
+			{
+				int new_job_core_id = -1;
+				for (j = 0; j < cores; j++)
+					if (assignment[j] == arrivals[i].job_number)
+						new_job_core_id = j;
+
+				if (new_job_core_id >= 0)
+					printf("A new job, job %d (running time=%d, priority=%d), arrived. Job %d is now running on core %d.\n",
+							arrivals[i].job_number, arrivals[i].running_time, arrivals[i].priority, arrivals[i].job_number, new_job_core_id);
+				else
+					printf("A new job, job %d (running time=%d, priority=%d), arrived. Job %d is set to idle (-1).\n",
+							arrivals[i].job_number, arrivals[i].running_time, arrivals[i].priority, arrivals[i].job_number);
+				printf("  Queue: "); scheduler_show_queue(); printf("\n\n");
+			}
+		}
+
+		if (active_jobs == 0)
+			break;
+
 
 		/*
 		 * 4. Run the time unit.
@@ -483,6 +638,11 @@ int main(int argc, char **argv)
 
 
 	free(quantum_clock);
+	free(arrivals);
+	free(completions);
+	free(expirations);
+	free(assignment);
+	free(previous);
 	for (i=0; i < cores; i++)
 		free(core_timing_diagram[i]);
 	free(core_timing_diagram);